@@ -0,0 +1,192 @@
+#ifndef GBATIVIDADE_ASSETARCHIVE_H
+#define GBATIVIDADE_ASSETARCHIVE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "MapFile.h"
+
+// Archive layout (little-endian):
+//   ArchiveHeader
+//   ArchiveEntry[entryCount], sorted by (hash, name)
+//   entry names, back to back without terminators
+//   payloads, each starting at a multiple of ALIGNMENT
+struct ArchiveHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+};
+
+struct ArchiveEntry {
+    uint64_t hash;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+};
+
+// Read-only pack of asset files, mapped once. Lookups binary-search the index by
+// the hash of the name and return spans straight into the mapping.
+class AssetArchive {
+private:
+    MappedFile file;
+    std::string path;
+    const ArchiveEntry *entries = nullptr;
+    uint32_t entryCount = 0;
+
+public:
+    static constexpr char MAGIC[4] = {'G', 'B', 'P', 'K'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint64_t ALIGNMENT = 64;
+
+    AssetArchive() = default;
+
+    explicit AssetArchive(const std::string &path) : file(path, false), path(path) {
+        const char *base = static_cast<const char *>(file.getData());
+        ArchiveHeader header{};
+        if (file.size() < sizeof(header)) {
+            throw std::runtime_error("Arquivo de assets truncado: " + path);
+        }
+        std::memcpy(&header, base, sizeof(header));
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+            throw std::runtime_error("Formato de arquivo de assets invalido: " + path);
+        }
+
+        uint64_t indexEnd = sizeof(header) + static_cast<uint64_t>(header.entryCount) * sizeof(ArchiveEntry);
+        if (indexEnd > file.size()) {
+            throw std::runtime_error("Arquivo de assets truncado: " + path);
+        }
+        entries = reinterpret_cast<const ArchiveEntry *>(base + sizeof(header));
+        entryCount = header.entryCount;
+        for (uint32_t n = 0; n < entryCount; n++) {
+            const ArchiveEntry &entry = entries[n];
+            if (indexEnd + entry.nameOffset + entry.nameLength > file.size() || entry.offset > file.size() ||
+                entry.size > file.size() - entry.offset) {
+                throw std::runtime_error("Entrada corrompida no arquivo de assets " + path);
+            }
+        }
+    }
+
+    bool isOpen() const {
+        return entries != nullptr;
+    }
+
+    uint32_t size() const {
+        return entryCount;
+    }
+
+    const std::string &getPath() const {
+        return path;
+    }
+
+    // Where a span returned by find() starts in the archive file
+    uint64_t offsetOf(std::span<const uint8_t> bytes) const {
+        return static_cast<uint64_t>(bytes.data() - static_cast<const uint8_t *>(file.getData()));
+    }
+
+    // FNV-1a of the entry name, e.g. "shaders/vertex.vert"
+    static uint64_t hashName(std::string_view name) {
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (char c: name) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+    // Contents of the named entry; an empty span with a null data() if absent
+    std::span<const uint8_t> find(std::string_view name) const {
+        if (!isOpen()) {
+            return {};
+        }
+        uint64_t hash = hashName(name);
+        const ArchiveEntry *end = entries + entryCount;
+        const ArchiveEntry *it = std::lower_bound(entries, end, hash, [](const ArchiveEntry &entry, uint64_t value) {
+            return entry.hash < value;
+        });
+        for (; it != end && it->hash == hash; ++it) {
+            if (entryName(*it) == name) {
+                return {static_cast<const uint8_t *>(file.getData()) + it->offset, static_cast<size_t>(it->size)};
+            }
+        }
+        return {};
+    }
+
+    // Packs files (entry name, path on disk) into a new archive at path
+    static void write(const std::string &path, const std::vector<std::pair<std::string, std::string>> &files) {
+        std::vector<ArchiveEntry> index(files.size());
+        std::vector<size_t> order(files.size());
+        for (size_t n = 0; n < files.size(); n++) {
+            index[n].hash = hashName(files[n].first);
+            order[n] = n;
+        }
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return std::make_pair(index[a].hash, files[a].first) < std::make_pair(index[b].hash, files[b].first);
+        });
+
+        std::string names;
+        std::vector<ArchiveEntry> sorted;
+        for (size_t n: order) {
+            ArchiveEntry entry = index[n];
+            entry.nameOffset = static_cast<uint32_t>(names.size());
+            entry.nameLength = static_cast<uint32_t>(files[n].first.size());
+            names += files[n].first;
+            sorted.push_back(entry);
+        }
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            throw std::runtime_error("Falha ao criar o arquivo de assets " + path);
+        }
+        ArchiveHeader header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.entryCount = static_cast<uint32_t>(files.size());
+
+        // Payload offsets are known once the index and names are laid out
+        uint64_t offset = sizeof(header) + sorted.size() * sizeof(ArchiveEntry) + names.size();
+        std::vector<std::vector<char>> payloads;
+        for (size_t n = 0; n < order.size(); n++) {
+            const std::string &source = files[order[n]].second;
+            std::ifstream in(source, std::ios::binary);
+            if (!in.is_open()) {
+                throw std::runtime_error("Falha ao abrir o arquivo " + source);
+            }
+            payloads.emplace_back(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            offset = (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+            sorted[n].offset = offset;
+            sorted[n].size = payloads.back().size();
+            offset += sorted[n].size;
+        }
+
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(sorted.data()), static_cast<std::streamsize>(sorted.size() * sizeof(ArchiveEntry)));
+        out.write(names.data(), static_cast<std::streamsize>(names.size()));
+        uint64_t written = sizeof(header) + sorted.size() * sizeof(ArchiveEntry) + names.size();
+        for (size_t n = 0; n < payloads.size(); n++) {
+            std::vector<char> padding(sorted[n].offset - written, 0);
+            out.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+            out.write(payloads[n].data(), static_cast<std::streamsize>(payloads[n].size()));
+            written = sorted[n].offset + sorted[n].size;
+        }
+        if (!out) {
+            throw std::runtime_error("Falha ao escrever o arquivo de assets " + path);
+        }
+    }
+
+private:
+    std::string_view entryName(const ArchiveEntry &entry) const {
+        const char *names = reinterpret_cast<const char *>(entries + entryCount);
+        return {names + entry.nameOffset, entry.nameLength};
+    }
+};
+
+#endif //GBATIVIDADE_ASSETARCHIVE_H
@@ -0,0 +1,377 @@
+#ifndef GBATIVIDADE_MAPFILE_H
+#define GBATIVIDADE_MAPFILE_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only (or copy-on-write) view of a file or of a range of it.
+class MappedFile {
+private:
+    void *data = nullptr;
+    size_t length = 0;
+    // The mapping itself, which starts at an aligned offset at or before data
+    void *view = nullptr;
+    size_t viewLength = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+public:
+    MappedFile() = default;
+
+    static constexpr size_t TO_END = std::numeric_limits<size_t>::max();
+
+    // copyOnWrite maps the pages privately: writes never reach the file and only
+    // the touched pages get copied
+    MappedFile(const std::string &path, bool copyOnWrite) : MappedFile(path, copyOnWrite, 0, TO_END) {
+    }
+
+    // Maps size bytes from offset, which needs no alignment; TO_END maps the rest
+    // of the file
+    MappedFile(const std::string &path, bool copyOnWrite, uint64_t offset, size_t size) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Falha ao abrir o arquivo " + path);
+        }
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        length = checkRange(path, static_cast<uint64_t>(fileSize.QuadPart), offset, size);
+        if (length > 0) {
+            SYSTEM_INFO system;
+            GetSystemInfo(&system);
+            uint64_t start = offset - offset % system.dwAllocationGranularity;
+            viewLength = static_cast<size_t>(offset - start) + length;
+            mapping = CreateFileMappingA(file, nullptr, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) {
+                view = MapViewOfFile(mapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ,
+                                     static_cast<DWORD>(start >> 32), static_cast<DWORD>(start), viewLength);
+            }
+            if (!view) {
+                release();
+                throw std::runtime_error("Falha ao mapear o arquivo " + path);
+            }
+            data = static_cast<char *>(view) + (offset - start);
+        }
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Falha ao abrir o arquivo " + path);
+        }
+        struct stat st{};
+        fstat(fd, &st);
+        try {
+            length = checkRange(path, static_cast<uint64_t>(st.st_size), offset, size);
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        if (length > 0) {
+            uint64_t start = offset - offset % static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+            int protection = copyOnWrite ? (PROT_READ | PROT_WRITE) : PROT_READ;
+            void *mapped = mmap(nullptr, static_cast<size_t>(offset - start) + length, protection, MAP_PRIVATE, fd,
+                                static_cast<off_t>(start));
+            if (mapped == MAP_FAILED) {
+                close(fd);
+                length = 0;
+                throw std::runtime_error("Falha ao mapear o arquivo " + path);
+            }
+            view = mapped;
+            viewLength = static_cast<size_t>(offset - start) + length;
+            data = static_cast<char *>(view) + (offset - start);
+        }
+        close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedFile &operator=(MappedFile &&other) noexcept {
+        if (this != &other) {
+            release();
+            std::swap(data, other.data);
+            std::swap(length, other.length);
+            std::swap(view, other.view);
+            std::swap(viewLength, other.viewLength);
+#ifdef _WIN32
+            std::swap(file, other.file);
+            std::swap(mapping, other.mapping);
+#endif
+        }
+        return *this;
+    }
+
+    ~MappedFile() {
+        release();
+    }
+
+    void *getData() const {
+        return data;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+private:
+    // Bytes to map, after checking the range lies within the file
+    static size_t checkRange(const std::string &path, uint64_t fileSize, uint64_t offset, size_t size) {
+        if (offset > fileSize || (size != TO_END && size > fileSize - offset)) {
+            throw std::runtime_error("Trecho fora do arquivo " + path);
+        }
+        return static_cast<size_t>(size == TO_END ? fileSize - offset : size);
+    }
+
+    void release() {
+#ifdef _WIN32
+        if (view) UnmapViewOfFile(view);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (view) munmap(view, viewLength);
+#endif
+        data = nullptr;
+        length = 0;
+        view = nullptr;
+        viewLength = 0;
+    }
+};
+
+// Binary map layout (little-endian):
+//   MapHeader, then width * height uint16_t tile indices, row-major (row = i, column = j)
+struct MapHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+};
+
+// Row-major grid of tile indices. Binary maps are memory-mapped copy-on-write, so
+// loading costs a header check no matter the size; text maps are parsed into one
+// contiguous buffer.
+class MapData {
+private:
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint16_t *cells = nullptr;
+    MappedFile mapped;
+    std::vector<uint16_t> owned;
+
+public:
+    static constexpr char MAGIC[4] = {'G', 'B', 'M', 'P'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t MAX_SIZE = 8192;
+
+    MapData() = default;
+
+    MapData(uint32_t width, uint32_t height, uint16_t fill = 0) {
+        checkSize(width, height);
+        this->width = width;
+        this->height = height;
+        owned.assign(static_cast<size_t>(width) * height, fill);
+        cells = owned.data();
+    }
+
+    MapData(const MapData &) = delete;
+    MapData &operator=(const MapData &) = delete;
+
+    MapData(MapData &&other) noexcept {
+        *this = std::move(other);
+    }
+
+    MapData &operator=(MapData &&other) noexcept {
+        if (this != &other) {
+            width = std::exchange(other.width, 0);
+            height = std::exchange(other.height, 0);
+            cells = std::exchange(other.cells, nullptr);
+            mapped = std::move(other.mapped);
+            owned = std::move(other.owned);
+        }
+        return *this;
+    }
+
+    // Picks the format from the first bytes of the file
+    static MapData load(const std::string &path) {
+        char magic[4] = {};
+        std::ifstream probe(path, std::ios::binary);
+        if (!probe.is_open()) {
+            throw std::runtime_error("Falha ao abrir o mapa " + path);
+        }
+        probe.read(magic, sizeof(magic));
+        probe.close();
+
+        if (std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0) {
+            return loadBinary(path);
+        }
+        return loadText(path);
+    }
+
+    static MapData loadBinary(const std::string &path) {
+        return loadBinary(path, 0, MappedFile::TO_END);
+    }
+
+    // A binary map stored at offset within a larger file, e.g. an asset archive;
+    // it gets its own copy-on-write view of that range, so nothing is copied
+    static MapData loadBinary(const std::string &path, uint64_t offset, size_t size) {
+        MapData result;
+        result.mapped = MappedFile(path, true, offset, size);
+
+        if (result.mapped.size() < sizeof(MapHeader)) {
+            throw std::runtime_error("Mapa binario truncado: " + path);
+        }
+        MapHeader header;
+        std::memcpy(&header, result.mapped.getData(), sizeof(header));
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+            throw std::runtime_error("Formato de mapa invalido: " + path);
+        }
+        checkSize(header.width, header.height);
+
+        size_t cellBytes = static_cast<size_t>(header.width) * header.height * sizeof(uint16_t);
+        if (result.mapped.size() < sizeof(MapHeader) + cellBytes) {
+            throw std::runtime_error("Mapa binario truncado: " + path);
+        }
+
+        result.width = header.width;
+        result.height = header.height;
+        result.cells = reinterpret_cast<uint16_t *>(static_cast<char *>(result.mapped.getData()) + sizeof(MapHeader));
+        return result;
+    }
+
+    // Text format: "width height" followed by width * height tile indices,
+    // one row per line by convention; '#' starts a comment
+    static MapData loadText(const std::string &path) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Falha ao abrir o mapa " + path);
+        }
+        return parseText(file, path);
+    }
+
+    static bool isBinary(const void *bytes, size_t size) {
+        return size >= sizeof(MAGIC) && std::memcmp(bytes, MAGIC, sizeof(MAGIC)) == 0;
+    }
+
+    // Text format from bytes already in memory (e.g. a packed asset)
+    static MapData loadTextFromMemory(const void *bytes, size_t size, const std::string &name) {
+        std::istringstream text(std::string(static_cast<const char *>(bytes), size));
+        return parseText(text, name);
+    }
+
+    void saveBinary(const std::string &path) const {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("Falha ao criar o mapa " + path);
+        }
+        MapHeader header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.width = width;
+        header.height = height;
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(cells), static_cast<std::streamsize>(cellCount() * sizeof(uint16_t)));
+    }
+
+    void saveText(const std::string &path) const {
+        std::ofstream file(path, std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("Falha ao criar o mapa " + path);
+        }
+        file << width << ' ' << height << '\n';
+        for (uint32_t i = 0; i < height; i++) {
+            const uint16_t *row = cells + static_cast<size_t>(i) * width;
+            for (uint32_t j = 0; j < width; j++) {
+                file << row[j] << (j + 1 < width ? ' ' : '\n');
+            }
+        }
+    }
+
+    uint32_t getWidth() const {
+        return width;
+    }
+
+    uint32_t getHeight() const {
+        return height;
+    }
+
+    size_t cellCount() const {
+        return static_cast<size_t>(width) * height;
+    }
+
+    uint16_t *data() {
+        return cells;
+    }
+
+    const uint16_t *data() const {
+        return cells;
+    }
+
+    uint16_t *operator[](uint32_t row) {
+        return cells + static_cast<size_t>(row) * width;
+    }
+
+    const uint16_t *operator[](uint32_t row) const {
+        return cells + static_cast<size_t>(row) * width;
+    }
+
+private:
+    static MapData parseText(std::istream &input, const std::string &path) {
+        std::stringstream content;
+        std::string line;
+        while (std::getline(input, line)) {
+            content << line.substr(0, line.find('#')) << '\n';
+        }
+
+        long long w = 0, h = 0;
+        if (!(content >> w >> h) || w <= 0 || h <= 0) {
+            throw std::runtime_error("Cabecalho de mapa invalido: " + path);
+        }
+        checkSize(static_cast<uint64_t>(w), static_cast<uint64_t>(h));
+
+        MapData result(static_cast<uint32_t>(w), static_cast<uint32_t>(h));
+        size_t count = result.cellCount();
+        for (size_t n = 0; n < count; n++) {
+            long long value;
+            if (!(content >> value) || value < 0 || value > UINT16_MAX) {
+                throw std::runtime_error("Tile invalido ou ausente no mapa " + path);
+            }
+            result.cells[n] = static_cast<uint16_t>(value);
+        }
+        return result;
+    }
+
+    static void checkSize(uint64_t w, uint64_t h) {
+        if (w == 0 || h == 0 || w > MAX_SIZE || h > MAX_SIZE) {
+            throw std::runtime_error("Dimensoes de mapa fora do limite (1.." + std::to_string(MAX_SIZE) + ")");
+        }
+    }
+};
+
+#endif //GBATIVIDADE_MAPFILE_H
@@ -0,0 +1,113 @@
+#ifndef GBATIVIDADE_PNGWRITER_H
+#define GBATIVIDADE_PNGWRITER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Minimal PNG encoder for frame dumps: 8-bit RGBA, no filtering and zlib "stored"
+// blocks, so files are large but writing costs little more than a memcpy.
+class PngWriter {
+public:
+    // pixels holds height rows of width RGBA texels; bottomUp flips them, which is
+    // what glReadPixels returns
+    static void write(const std::string &path, uint32_t width, uint32_t height, const uint8_t *pixels,
+                      bool bottomUp) {
+        const size_t rowBytes = static_cast<size_t>(width) * 4;
+
+        // Each scanline is prefixed by its filter type (0, none)
+        std::vector<uint8_t> raw;
+        raw.reserve((rowBytes + 1) * height);
+        for (uint32_t y = 0; y < height; y++) {
+            const uint8_t *row = pixels + rowBytes * (bottomUp ? height - 1 - y : y);
+            raw.push_back(0);
+            raw.insert(raw.end(), row, row + rowBytes);
+        }
+
+        std::vector<uint8_t> zlib = {0x78, 0x01};
+        const size_t MAX_BLOCK = 65535;
+        for (size_t offset = 0; offset < raw.size() || offset == 0; offset += MAX_BLOCK) {
+            size_t length = std::min(MAX_BLOCK, raw.size() - offset);
+            bool last = offset + length >= raw.size();
+            zlib.push_back(last ? 1 : 0);
+            zlib.push_back(static_cast<uint8_t>(length));
+            zlib.push_back(static_cast<uint8_t>(length >> 8));
+            zlib.push_back(static_cast<uint8_t>(~length));
+            zlib.push_back(static_cast<uint8_t>(~length >> 8));
+            zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+            if (last) {
+                break;
+            }
+        }
+        appendBigEndian(zlib, adler32(raw));
+
+        std::vector<uint8_t> header;
+        appendBigEndian(header, width);
+        appendBigEndian(header, height);
+        header.insert(header.end(), {8, 6, 0, 0, 0});
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Falha ao criar o arquivo " + path);
+        }
+        static const uint8_t SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        file.write(reinterpret_cast<const char *>(SIGNATURE), sizeof(SIGNATURE));
+        writeChunk(file, "IHDR", header);
+        writeChunk(file, "IDAT", zlib);
+        writeChunk(file, "IEND", {});
+        if (!file) {
+            throw std::runtime_error("Falha ao escrever o arquivo " + path);
+        }
+    }
+
+private:
+    static void appendBigEndian(std::vector<uint8_t> &out, uint32_t value) {
+        out.push_back(static_cast<uint8_t>(value >> 24));
+        out.push_back(static_cast<uint8_t>(value >> 16));
+        out.push_back(static_cast<uint8_t>(value >> 8));
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    static uint32_t adler32(const std::vector<uint8_t> &data) {
+        uint32_t a = 1, b = 0;
+        for (uint8_t byte: data) {
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    static uint32_t crc32(const uint8_t *data, size_t length, uint32_t crc) {
+        static const std::array<uint32_t, 256> table = [] {
+            std::array<uint32_t, 256> entries{};
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                entries[n] = c;
+            }
+            return entries;
+        }();
+        for (size_t n = 0; n < length; n++) {
+            crc = table[(crc ^ data[n]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+    static void writeChunk(std::ofstream &file, const char type[4], const std::vector<uint8_t> &data) {
+        std::vector<uint8_t> out;
+        appendBigEndian(out, static_cast<uint32_t>(data.size()));
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        uint32_t crc = crc32(out.data() + 4, out.size() - 4, 0xFFFFFFFFu) ^ 0xFFFFFFFFu;
+        appendBigEndian(out, crc);
+        file.write(reinterpret_cast<const char *>(out.data()), static_cast<std::streamsize>(out.size()));
+    }
+};
+
+#endif
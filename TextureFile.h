@@ -0,0 +1,209 @@
+#ifndef GBATIVIDADE_TEXTUREFILE_H
+#define GBATIVIDADE_TEXTUREFILE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Cooked texture layout (little-endian):
+//   TextureFileHeader
+//   TextureFileLevel[levelCount], largest level first
+//   level data, each starting at a multiple of ALIGNMENT
+struct TextureFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t format;
+    uint32_t flags;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t reserved;
+};
+
+struct TextureFileLevel {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+};
+
+// GPU-ready texture: every mip level stored as the GL upload expects it, so
+// loading is a header check and one glTexSubImage2D per level. Only RGBA8 with
+// premultiplied alpha is produced for now; format leaves room for compressed
+// formats.
+class TextureFile {
+private:
+    TextureFileHeader header{};
+    std::vector<TextureFileLevel> levels;
+    const uint8_t *base = nullptr;
+
+public:
+    static constexpr char MAGIC[4] = {'G', 'B', 'T', 'X'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t FORMAT_RGBA8 = 1;
+    static constexpr uint32_t FLAG_PREMULTIPLIED = 1;
+    static constexpr uint32_t MAX_LEVELS = 16;
+    static constexpr uint64_t ALIGNMENT = 64;
+
+    static bool isTextureFile(std::span<const uint8_t> bytes) {
+        return bytes.size() >= sizeof(MAGIC) && std::memcmp(bytes.data(), MAGIC, sizeof(MAGIC)) == 0;
+    }
+
+    // A view over bytes, which must outlive the result
+    static TextureFile parse(std::span<const uint8_t> bytes, const std::string &name) {
+        TextureFile file;
+        if (bytes.size() < sizeof(TextureFileHeader)) {
+            throw std::runtime_error("Textura truncada: " + name);
+        }
+        std::memcpy(&file.header, bytes.data(), sizeof(TextureFileHeader));
+        const TextureFileHeader &header = file.header;
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+            header.format != FORMAT_RGBA8) {
+            throw std::runtime_error("Formato de textura invalido: " + name);
+        }
+        if (header.levelCount == 0 || header.levelCount > MAX_LEVELS || header.width == 0 || header.height == 0) {
+            throw std::runtime_error("Cabecalho de textura invalido: " + name);
+        }
+
+        size_t indexEnd = sizeof(TextureFileHeader) + header.levelCount * sizeof(TextureFileLevel);
+        if (bytes.size() < indexEnd) {
+            throw std::runtime_error("Textura truncada: " + name);
+        }
+        file.levels.resize(header.levelCount);
+        std::memcpy(file.levels.data(), bytes.data() + sizeof(TextureFileHeader), header.levelCount * sizeof(TextureFileLevel));
+        for (uint32_t n = 0; n < header.levelCount; n++) {
+            // Each level halves the previous one, as glTexStorage2D allocates them
+            const TextureFileLevel &level = file.levels[n];
+            if (level.width != std::max(header.width >> n, 1u) || level.height != std::max(header.height >> n, 1u) ||
+                level.size != static_cast<uint64_t>(level.width) * level.height * 4 || level.offset > bytes.size() ||
+                level.size > bytes.size() - level.offset) {
+                throw std::runtime_error("Nivel de mipmap corrompido na textura " + name);
+            }
+        }
+        file.base = bytes.data();
+        return file;
+    }
+
+    uint32_t getWidth() const {
+        return header.width;
+    }
+
+    uint32_t getHeight() const {
+        return header.height;
+    }
+
+    uint32_t getLevelCount() const {
+        return header.levelCount;
+    }
+
+    bool isPremultiplied() const {
+        return (header.flags & FLAG_PREMULTIPLIED) != 0;
+    }
+
+    const TextureFileLevel &getLevel(uint32_t level) const {
+        return levels[level];
+    }
+
+    const uint8_t *levelData(uint32_t level) const {
+        return base + levels[level].offset;
+    }
+
+    // Total bytes of pixel data over all levels
+    uint64_t dataSize() const {
+        uint64_t total = 0;
+        for (const TextureFileLevel &level: levels) {
+            total += level.size;
+        }
+        return total;
+    }
+
+    // Scales color by alpha in place, rounding to nearest
+    static void premultiply(uint8_t *rgba, size_t pixelCount) {
+        for (size_t n = 0; n < pixelCount; n++, rgba += 4) {
+            uint32_t alpha = rgba[3];
+            for (int c = 0; c < 3; c++) {
+                rgba[c] = static_cast<uint8_t>((rgba[c] * alpha + 127) / 255);
+            }
+        }
+    }
+
+    // The given level followed by box-filtered halvings down to 1x1, or until
+    // maxLevels levels; averaging premultiplied texels keeps edges from darkening
+    static std::vector<std::vector<uint8_t>> buildMipChain(std::vector<uint8_t> base, uint32_t width, uint32_t height,
+                                                           uint32_t maxLevels) {
+        std::vector<std::vector<uint8_t>> chain;
+        chain.push_back(std::move(base));
+        while ((width > 1 || height > 1) && chain.size() < std::min(maxLevels, MAX_LEVELS)) {
+            uint32_t nextWidth = std::max(width / 2, 1u);
+            uint32_t nextHeight = std::max(height / 2, 1u);
+            const std::vector<uint8_t> &source = chain.back();
+            std::vector<uint8_t> next(static_cast<size_t>(nextWidth) * nextHeight * 4);
+            for (uint32_t y = 0; y < nextHeight; y++) {
+                for (uint32_t x = 0; x < nextWidth; x++) {
+                    // Odd sizes fold the last row/column into the last texel
+                    uint32_t x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+                    uint32_t y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+                    for (int c = 0; c < 4; c++) {
+                        uint32_t sum = source[(static_cast<size_t>(y0) * width + x0) * 4 + c] +
+                                       source[(static_cast<size_t>(y0) * width + x1) * 4 + c] +
+                                       source[(static_cast<size_t>(y1) * width + x0) * 4 + c] +
+                                       source[(static_cast<size_t>(y1) * width + x1) * 4 + c];
+                        next[(static_cast<size_t>(y) * nextWidth + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+                    }
+                }
+            }
+            chain.push_back(std::move(next));
+            width = nextWidth;
+            height = nextHeight;
+        }
+        return chain;
+    }
+
+    // Writes premultiplied RGBA8 levels, largest first
+    static void write(const std::string &path, uint32_t width, uint32_t height,
+                      const std::vector<std::vector<uint8_t>> &chain) {
+        TextureFileHeader header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.format = FORMAT_RGBA8;
+        header.flags = FLAG_PREMULTIPLIED;
+        header.width = width;
+        header.height = height;
+        header.levelCount = static_cast<uint32_t>(chain.size());
+
+        std::vector<TextureFileLevel> index(chain.size());
+        uint64_t offset = sizeof(header) + index.size() * sizeof(TextureFileLevel);
+        for (size_t n = 0; n < chain.size(); n++) {
+            offset = (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+            index[n].offset = offset;
+            index[n].size = chain[n].size();
+            index[n].width = std::max(width >> n, 1u);
+            index[n].height = std::max(height >> n, 1u);
+            offset += index[n].size;
+        }
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            throw std::runtime_error("Falha ao criar a textura " + path);
+        }
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(index.data()), static_cast<std::streamsize>(index.size() * sizeof(TextureFileLevel)));
+        uint64_t written = sizeof(header) + index.size() * sizeof(TextureFileLevel);
+        for (size_t n = 0; n < chain.size(); n++) {
+            std::vector<char> padding(index[n].offset - written, 0);
+            out.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+            out.write(reinterpret_cast<const char *>(chain[n].data()), static_cast<std::streamsize>(chain[n].size()));
+            written = index[n].offset + index[n].size;
+        }
+        if (!out) {
+            throw std::runtime_error("Falha ao escrever a textura " + path);
+        }
+    }
+};
+
+#endif //GBATIVIDADE_TEXTUREFILE_H
@@ -2,366 +2,3854 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #define STB_IMAGE_IMPLEMENTATION
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <sstream>
 #include <stb_image.h>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "AssetArchive.h"
+#include "MapFile.h"
+#include "PngWriter.h"
+#include "TextureFile.h"
 
 using namespace std;
 using namespace glm;
 
-struct Tile {
-    GLuint VAO;
-    GLuint texID;
-    GLint iTile;
-    vec3 position;
-    vec3 dimensions;
-    GLfloat ds, dt;
-    GLboolean caminhavel;
+// Messages below GB_LOG_LEVEL are compiled out: 0 trace, 1 debug, 2 info, 3 warn, 4 error
+#ifndef GB_LOG_LEVEL
+#define GB_LOG_LEVEL 2
+#endif
+
+enum class LogLevel : uint8_t {
+    Trace, Debug, Info, Warn, Error
+};
+
+// Asynchronous logger. Callers only copy the format pointer and up to MAX_ARGS
+// arguments into a lock-free bounded ring (no formatting, no allocation, no I/O);
+// a background thread formats "{}" placeholders and writes whole batches. When the
+// ring is full the message is dropped and counted instead of blocking the caller.
+class Logger {
+private:
+    static constexpr size_t CAPACITY = 4096;
+    static constexpr size_t MAX_ARGS = 6;
+    static constexpr size_t TEXT_SIZE = 96;
+
+    struct Arg {
+        enum Kind : uint8_t { Int, UInt, Double, Text } kind;
+        union {
+            int64_t i;
+            uint64_t u;
+            double d;
+            struct {
+                uint16_t offset, length;
+            } text;
+        };
+    };
+
+    struct Entry {
+        atomic<size_t> sequence;
+        LogLevel level;
+        uint8_t argCount;
+        uint16_t textUsed;
+        double time;
+        const char *format;
+        Arg args[MAX_ARGS];
+        char text[TEXT_SIZE];
+    };
+
+    unique_ptr<Entry[]> ring;
+    alignas(64) atomic<size_t> enqueuePos{0};
+    alignas(64) atomic<size_t> dequeuePos{0};
+    atomic<uint64_t> dropped{0};
+    atomic<bool> running{true};
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    thread writer;
+
+    Logger() : ring(new Entry[CAPACITY]) {
+        for (size_t n = 0; n < CAPACITY; n++) {
+            ring[n].sequence.store(n, memory_order_relaxed);
+        }
+        writer = thread([this] { writerLoop(); });
+    }
+
+public:
+    static Logger &instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    ~Logger() {
+        running.store(false, memory_order_release);
+        writer.join();
+    }
+
+    Logger(const Logger &) = delete;
+    Logger &operator=(const Logger &) = delete;
+
+    template<typename... Args>
+    void log(LogLevel level, const char *format, const Args &... args) {
+        static_assert(sizeof...(Args) <= MAX_ARGS, "Argumentos demais para uma mensagem de log");
+
+        size_t pos = enqueuePos.load(memory_order_relaxed);
+        Entry *entry;
+        for (;;) {
+            entry = &ring[pos % CAPACITY];
+            size_t sequence = entry->sequence.load(memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                dropped.fetch_add(1, memory_order_relaxed);
+                return;
+            } else {
+                pos = enqueuePos.load(memory_order_relaxed);
+            }
+        }
+
+        entry->level = level;
+        entry->time = seconds();
+        entry->format = format;
+        entry->argCount = 0;
+        entry->textUsed = 0;
+        (capture(*entry, args), ...);
+        entry->sequence.store(pos + 1, memory_order_release);
+    }
+
+    // Seconds since the logger started, the timestamp printed with every message
+    double seconds() const {
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    uint64_t getDropped() const {
+        return dropped.load(memory_order_relaxed);
+    }
+
+    // Blocks until everything queued so far has been written
+    void flush() {
+        size_t target = enqueuePos.load(memory_order_acquire);
+        while (dequeuePos.load(memory_order_acquire) < target) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }
+
+private:
+    template<typename T>
+    static void capture(Entry &entry, const T &value) {
+        Arg &arg = entry.args[entry.argCount++];
+        if constexpr (is_same_v<T, bool>) {
+            arg.kind = Arg::Int;
+            arg.i = value ? 1 : 0;
+        } else if constexpr (is_integral_v<T> && is_signed_v<T>) {
+            arg.kind = Arg::Int;
+            arg.i = value;
+        } else if constexpr (is_integral_v<T>) {
+            arg.kind = Arg::UInt;
+            arg.u = value;
+        } else if constexpr (is_floating_point_v<T>) {
+            arg.kind = Arg::Double;
+            arg.d = value;
+        } else {
+            captureText(entry, arg, string_view(value));
+        }
+    }
+
+    // Strings are copied (truncated) into the entry, so callers may pass temporaries
+    static void captureText(Entry &entry, Arg &arg, string_view value) {
+        size_t length = std::min(value.size(), TEXT_SIZE - entry.textUsed);
+        memcpy(entry.text + entry.textUsed, value.data(), length);
+        arg.kind = Arg::Text;
+        arg.text.offset = entry.textUsed;
+        arg.text.length = static_cast<uint16_t>(length);
+        entry.textUsed = static_cast<uint16_t>(entry.textUsed + length);
+    }
+
+    void writerLoop() {
+        string out, err;
+        for (;;) {
+            bool stopping = !running.load(memory_order_acquire);
+            size_t written = 0;
+            size_t pos = dequeuePos.load(memory_order_relaxed);
+            for (;;) {
+                Entry &entry = ring[pos % CAPACITY];
+                if (entry.sequence.load(memory_order_acquire) != pos + 1) {
+                    break;
+                }
+                format(entry, entry.level >= LogLevel::Warn ? err : out);
+                entry.sequence.store(pos + CAPACITY, memory_order_release);
+                pos++;
+                written++;
+            }
+
+            uint64_t lost = dropped.exchange(0, memory_order_relaxed);
+            if (lost > 0) {
+                err += "[log] " + to_string(lost) + " messages dropped\n";
+            }
+            if (!out.empty()) {
+                fwrite(out.data(), 1, out.size(), stdout);
+                fflush(stdout);
+                out.clear();
+            }
+            if (!err.empty()) {
+                fwrite(err.data(), 1, err.size(), stderr);
+                err.clear();
+            }
+            dequeuePos.store(pos, memory_order_release);
+
+            if (stopping) {
+                return;
+            }
+            if (written == 0) {
+                this_thread::sleep_for(chrono::milliseconds(2));
+            }
+        }
+    }
+
+    static void format(const Entry &entry, string &out) {
+        static constexpr const char *LEVEL_NAMES[] = {"TRACE", "DEBUG", "INFO ", "WARN ", "ERROR"};
+        char prefix[32];
+        snprintf(prefix, sizeof(prefix), "[%10.4f] %s ", entry.time, LEVEL_NAMES[static_cast<int>(entry.level)]);
+        out += prefix;
+
+        size_t next = 0;
+        for (const char *c = entry.format; *c; c++) {
+            if (c[0] == '{' && c[1] == '}' && next < entry.argCount) {
+                appendArg(entry, entry.args[next++], out);
+                c++;
+            } else {
+                out += *c;
+            }
+        }
+        out += '\n';
+    }
+
+    static void appendArg(const Entry &entry, const Arg &arg, string &out) {
+        char buffer[32];
+        switch (arg.kind) {
+            case Arg::Int:
+                snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(arg.i));
+                break;
+            case Arg::UInt:
+                snprintf(buffer, sizeof(buffer), "%llu", static_cast<unsigned long long>(arg.u));
+                break;
+            case Arg::Double:
+                snprintf(buffer, sizeof(buffer), "%g", arg.d);
+                break;
+            case Arg::Text:
+                out.append(entry.text + arg.text.offset, arg.text.length);
+                return;
+        }
+        out += buffer;
+    }
+};
+
+#define GB_LOG(level, ...) \
+    do { \
+        if constexpr (static_cast<int>(level) >= GB_LOG_LEVEL) { \
+            Logger::instance().log(level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_TRACE(...) GB_LOG(LogLevel::Trace, __VA_ARGS__)
+#define LOG_DEBUG(...) GB_LOG(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...) GB_LOG(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...) GB_LOG(LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) GB_LOG(LogLevel::Error, __VA_ARGS__)
+
+// Logs at most once per interval (seconds) from this call site; suppressed calls
+// cost one relaxed atomic load
+#define LOG_EVERY(interval, level, ...) \
+    do { \
+        if constexpr (static_cast<int>(level) >= GB_LOG_LEVEL) { \
+            static atomic<double> gbLogNext{0.0}; \
+            double gbLogNow = Logger::instance().seconds(); \
+            double gbLogExpected = gbLogNext.load(memory_order_relaxed); \
+            if (gbLogNow >= gbLogExpected && \
+                gbLogNext.compare_exchange_strong(gbLogExpected, gbLogNow + (interval), memory_order_relaxed)) { \
+                Logger::instance().log(level, __VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
+// GL_TIME_ELAPSED queries read back a few frames late so the CPU never waits on
+// them. begin()/end() bracket one measurement; collect() returns the finished ones.
+class GpuTimerPool {
+private:
+    vector<GLuint> queries;
+    size_t next = 0;
+    size_t inFlight = 0;
+
+public:
+    explicit GpuTimerPool(size_t poolSize = 8) : queries(poolSize) {
+        glGenQueries(static_cast<GLsizei>(queries.size()), queries.data());
+    }
+
+    ~GpuTimerPool() {
+        glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+    }
+
+    GpuTimerPool(const GpuTimerPool &) = delete;
+    GpuTimerPool &operator=(const GpuTimerPool &) = delete;
+
+    // Returns false when every query is still pending; that measurement is skipped
+    GLboolean begin() {
+        if (inFlight == queries.size()) {
+            return false;
+        }
+        glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+        return true;
+    }
+
+    GLvoid end() {
+        glEndQuery(GL_TIME_ELAPSED);
+        next = (next + 1) % queries.size();
+        inFlight++;
+    }
+
+    // Appends the elapsed seconds of finished queries, oldest first; wait blocks
+    // until all of them are done
+    GLvoid collect(vector<double> &out, GLboolean wait = false) {
+        while (inFlight > 0) {
+            GLuint query = queries[(next + queries.size() - inFlight) % queries.size()];
+            if (!wait) {
+                GLint available = 0;
+                glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available) {
+                    return;
+                }
+            }
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+            out.push_back(static_cast<double>(nanoseconds) * 1e-9);
+            inFlight--;
+        }
+    }
+};
+
+// GPU duration of a span of each frame from a pair of GL_TIMESTAMP queries. Unlike
+// GL_TIME_ELAPSED these can enclose other timer queries (the profiler's scopes).
+// Results are read back a few frames late without waiting, except when collect()
+// is told to drain them.
+class GpuFrameTimer {
+private:
+    static constexpr size_t FRAMES_IN_FLIGHT = 4;
+
+    array<GLuint, FRAMES_IN_FLIGHT * 2> queries{};
+    size_t next = 0;
+    size_t inFlight = 0;
+    GLboolean open = false;
+
+public:
+    GpuFrameTimer() {
+        glGenQueries(static_cast<GLsizei>(queries.size()), queries.data());
+    }
+
+    ~GpuFrameTimer() {
+        glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+    }
+
+    GpuFrameTimer(const GpuFrameTimer &) = delete;
+    GpuFrameTimer &operator=(const GpuFrameTimer &) = delete;
+
+    // Skips the frame when every pair is still pending
+    GLvoid begin() {
+        open = inFlight < FRAMES_IN_FLIGHT;
+        if (open) {
+            glQueryCounter(queries[next * 2], GL_TIMESTAMP);
+        }
+    }
+
+    GLvoid end() {
+        if (open) {
+            glQueryCounter(queries[next * 2 + 1], GL_TIMESTAMP);
+            next = (next + 1) % FRAMES_IN_FLIGHT;
+            inFlight++;
+            open = false;
+        }
+    }
+
+    // Latest finished frame's duration in seconds, false when none finished
+    GLboolean poll(double &seconds) {
+        GLboolean found = false;
+        while (takeOldest(seconds, false)) {
+            found = true;
+        }
+        return found;
+    }
+
+    // Appends the duration of every finished frame in seconds, oldest first;
+    // with wait, blocks until all frames in flight have finished
+    GLvoid collect(vector<double> &seconds, GLboolean wait = false) {
+        double frame;
+        while (takeOldest(frame, wait)) {
+            seconds.push_back(frame);
+        }
+    }
+
+private:
+    GLboolean takeOldest(double &seconds, GLboolean wait) {
+        if (inFlight == 0) {
+            return false;
+        }
+        size_t oldest = (next + FRAMES_IN_FLIGHT - inFlight) % FRAMES_IN_FLIGHT;
+        if (!wait) {
+            GLint available = 0;
+            glGetQueryObjectiv(queries[oldest * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                return false;
+            }
+        }
+        GLuint64 start = 0, end = 0;
+        glGetQueryObjectui64v(queries[oldest * 2], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(queries[oldest * 2 + 1], GL_QUERY_RESULT, &end);
+        seconds = static_cast<double>(end - start) * 1e-9;
+        inFlight--;
+        return true;
+    }
+};
+
+// Scoped CPU/GPU profiler, compiled in only with GB_PROFILE; otherwise every
+// PROFILE_* macro expands to nothing. Markers record only while a capture of
+// CAPTURE_FRAMES frames is running (F9 in game), which is written out as Chrome
+// trace_event JSON for chrome://tracing or Perfetto.
+//
+// CPU scopes use steady_clock and may nest and run on any thread. GPU scopes use
+// GL_TIME_ELAPSED queries, which cannot nest: a GPU scope opened inside another
+// one is recorded on the CPU only. Their results are read back frames later and
+// placed on a separate "GPU" track at the time the commands were submitted.
+#ifdef GB_PROFILE
+class Profiler {
+private:
+    using Clock = chrono::steady_clock;
+
+    static constexpr GLuint64 CAPTURE_FRAMES = 120;
+    static constexpr GLint GPU_TRACK = 0;
+    static constexpr size_t GPU_QUERIES = 256;
+
+    struct Event {
+        const char *name;
+        GLint track;
+        double start;
+        double duration;
+    };
+
+    struct PendingGpuScope {
+        const char *name;
+        double start;
+    };
+
+    const Clock::time_point epoch = Clock::now();
+    atomic<bool> capturing{false};
+    mutex eventsMutex;
+    vector<Event> events;
+    atomic<GLint> nextTrack{GPU_TRACK + 1};
+
+    // Main thread only
+    GLboolean captureOpen = false;
+    GLuint64 framesLeft = 0;
+    GLuint captureCount = 0;
+    unique_ptr<GpuTimerPool> gpuTimers;
+    deque<PendingGpuScope> pendingGpu;
+    vector<double> gpuResults;
+    GLboolean gpuScopeOpen = false;
+
+    Profiler() = default;
+
+public:
+    static Profiler &instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    GLboolean isCapturing() const {
+        return capturing.load(memory_order_relaxed);
+    }
+
+    double now() const {
+        return chrono::duration<double>(Clock::now() - epoch).count();
+    }
+
+    // Starts recording now for the next CAPTURE_FRAMES frames; ignored while a
+    // capture is still open
+    GLvoid requestCapture() {
+        if (captureOpen) {
+            return;
+        }
+        captureOpen = true;
+        framesLeft = CAPTURE_FRAMES;
+        capturing.store(true, memory_order_relaxed);
+        LOG_INFO("Profiler capture started ({} frames)", CAPTURE_FRAMES);
+    }
+
+    // Call once per frame on the thread owning the GL context
+    GLvoid frameBoundary() {
+        if (gpuTimers) {
+            collectGpu(false);
+        }
+        if (isCapturing() && --framesLeft == 0) {
+            capturing.store(false, memory_order_relaxed);
+        }
+        // Once the last GPU results are in, the capture is complete
+        if (captureOpen && !isCapturing() && pendingGpu.empty()) {
+            finishCapture();
+        }
+    }
+
+    // Writes an unfinished capture and drops its GL objects; call while the
+    // context still exists
+    GLvoid shutdown() {
+        if (captureOpen) {
+            capturing.store(false, memory_order_relaxed);
+            if (gpuTimers) {
+                collectGpu(true);
+            }
+            finishCapture();
+        }
+    }
+
+    GLvoid recordCpu(const char *name, double start, double end) {
+        static thread_local GLint track = nextTrack.fetch_add(1, memory_order_relaxed);
+        lock_guard<mutex> lock(eventsMutex);
+        events.push_back({name, track, start, end - start});
+    }
+
+    GLboolean beginGpu(const char *name) {
+        if (!isCapturing() || gpuScopeOpen) {
+            return false;
+        }
+        if (!gpuTimers) {
+            gpuTimers = make_unique<GpuTimerPool>(GPU_QUERIES);
+        }
+        if (!gpuTimers->begin()) {
+            return false;
+        }
+        gpuScopeOpen = true;
+        pendingGpu.push_back({name, now()});
+        return true;
+    }
+
+    GLvoid endGpu() {
+        gpuTimers->end();
+        gpuScopeOpen = false;
+    }
+
+private:
+    GLvoid finishCapture() {
+        gpuTimers.reset();
+        writeTrace();
+        captureOpen = false;
+    }
+
+    GLvoid collectGpu(GLboolean wait) {
+        gpuResults.clear();
+        gpuTimers->collect(gpuResults, wait);
+        lock_guard<mutex> lock(eventsMutex);
+        for (double duration: gpuResults) {
+            events.push_back({pendingGpu.front().name, GPU_TRACK, pendingGpu.front().start, duration});
+            pendingGpu.pop_front();
+        }
+    }
+
+    GLvoid writeTrace() {
+        string path = "profile_" + to_string(captureCount++) + ".json";
+        ofstream trace(path);
+        if (!trace.is_open()) {
+            LOG_ERROR("Failed to write profiler capture {}", path);
+            return;
+        }
+
+        lock_guard<mutex> lock(eventsMutex);
+        trace << "{\"traceEvents\": [\n";
+        trace << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << GPU_TRACK
+              << ", \"args\": {\"name\": \"GPU\"}}";
+        for (const Event &event: events) {
+            trace << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << event.track
+                  << ", \"ts\": " << event.start * 1e6 << ", \"dur\": " << event.duration * 1e6 << "}";
+        }
+        trace << "\n]}\n";
+        LOG_INFO("Profiler capture written to {} ({} events)", path, events.size());
+        events.clear();
+    }
+};
+
+class CpuProfileScope {
+private:
+    const char *name;
+    double start;
+
+public:
+    explicit CpuProfileScope(const char *name) : name(name), start(-1.0) {
+        if (Profiler::instance().isCapturing()) {
+            start = Profiler::instance().now();
+        }
+    }
+
+    ~CpuProfileScope() {
+        if (start >= 0.0) {
+            Profiler::instance().recordCpu(name, start, Profiler::instance().now());
+        }
+    }
+
+    CpuProfileScope(const CpuProfileScope &) = delete;
+    CpuProfileScope &operator=(const CpuProfileScope &) = delete;
+};
+
+class GpuProfileScope {
+private:
+    GLboolean active;
+
+public:
+    explicit GpuProfileScope(const char *name) : active(Profiler::instance().beginGpu(name)) {
+    }
+
+    ~GpuProfileScope() {
+        if (active) {
+            Profiler::instance().endGpu();
+        }
+    }
+
+    GpuProfileScope(const GpuProfileScope &) = delete;
+    GpuProfileScope &operator=(const GpuProfileScope &) = delete;
+};
+
+#define GB_PROFILE_CONCAT_(a, b) a##b
+#define GB_PROFILE_CONCAT(a, b) GB_PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) CpuProfileScope GB_PROFILE_CONCAT(gbProfileCpu, __LINE__)(name)
+// CPU and GPU time of the enclosing scope
+#define PROFILE_GPU_SCOPE(name) \
+    CpuProfileScope GB_PROFILE_CONCAT(gbProfileCpu, __LINE__)(name); \
+    GpuProfileScope GB_PROFILE_CONCAT(gbProfileGpu, __LINE__)(name)
+#define PROFILE_FRAME() Profiler::instance().frameBoundary()
+#define PROFILE_REQUEST_CAPTURE() Profiler::instance().requestCapture()
+#define PROFILE_SHUTDOWN() Profiler::instance().shutdown()
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_GPU_SCOPE(name)
+#define PROFILE_FRAME()
+#define PROFILE_REQUEST_CAPTURE()
+#define PROFILE_SHUTDOWN()
+#endif
+
+// Contents of an asset: a span into the mounted archive, or a loose file read
+// into owned storage
+struct AssetData {
+    span<const uint8_t> bytes;
+    vector<uint8_t> owned;
+
+    string_view text() const {
+        return {reinterpret_cast<const char *>(bytes.data()), bytes.size()};
+    }
+};
+
+// Where assets come from. With an archive mounted, lookups return zero-copy spans
+// into its mapping; anything not packed (or everything, when no archive was
+// found, e.g. running from the source tree) is read from loose files. Mount once
+// at startup; lookups may then come from any thread.
+class Assets {
+private:
+    AssetArchive archive;
+
+    Assets() = default;
+
+public:
+    static Assets &instance() {
+        static Assets assets;
+        return assets;
+    }
+
+    GLvoid mount(const string &archivePath) {
+        if (!filesystem::exists(archivePath)) {
+            LOG_INFO("No asset archive at {}, using loose files", archivePath);
+            return;
+        }
+        archive = AssetArchive(archivePath);
+        LOG_INFO("Mounted asset archive {} ({} entries)", archivePath, archive.size());
+    }
+
+    AssetData load(const string &path) const {
+        AssetData data;
+        data.bytes = archive.find(path);
+        if (data.bytes.data()) {
+            return data;
+        }
+
+        ifstream file(path, ios::binary);
+        if (!file.is_open()) {
+            throw runtime_error("Falha ao abrir o arquivo " + path);
+        }
+        data.owned.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        data.bytes = data.owned;
+        return data;
+    }
+
+    GLboolean contains(const string &path) const {
+        return archive.find(path).data() != nullptr || filesystem::exists(path);
+    }
+
+    // Binary maps are mapped copy-on-write, packed ones straight from their range
+    // of the archive; only text maps are parsed into memory
+    MapData loadMap(const string &path) const {
+        span<const uint8_t> packed = archive.find(path);
+        if (packed.data()) {
+            if (MapData::isBinary(packed.data(), packed.size())) {
+                return MapData::loadBinary(archive.getPath(), archive.offsetOf(packed), packed.size());
+            }
+            return MapData::loadTextFromMemory(packed.data(), packed.size(), path);
+        }
+        return MapData::load(path);
+    }
+};
+
+// Columns [begin, end) of one visible map row
+struct RowSpan {
+    GLint begin, end;
+};
+
+// Cells of the map that overlap the view: one column span per row in [firstRow, lastRow)
+struct VisibleRange {
+    GLint firstRow = 0;
+    GLint lastRow = 0;
+    vector<RowSpan> spans;
+
+    GLboolean contains(GLint i, GLint j) const {
+        if (i < firstRow || i >= lastRow) {
+            return false;
+        }
+        const RowSpan &span = spans[i - firstRow];
+        return j >= span.begin && j < span.end;
+    }
+
+    size_t cellCount() const {
+        size_t count = 0;
+        for (const RowSpan &span: spans) {
+            count += static_cast<size_t>(span.end - span.begin);
+        }
+        return count;
+    }
+};
+
+// Isometric layout of the grid in world space: cell (i, j) has its top-left
+// corner at ((j - i) * w/2, (j + i) * h/2) and covers w x h units
+struct IsoGrid {
+    vec2 tileSize;
+
+    vec2 toWorld(GLfloat i, GLfloat j) const {
+        return vec2((j - i) * tileSize.x, (j + i) * tileSize.y) / 2.0f;
+    }
+
+    vec2 cellCenter(GLfloat i, GLfloat j) const {
+        return toWorld(i, j) + tileSize / 2.0f;
+    }
+
+    // Inverts the layout for a world rectangle (left, top, right, bottom). With
+    // u = j - i and v = j + i a cell is visible when u and v fall in integer
+    // intervals, which gives the row range and each row's span in O(1) per row.
+    VisibleRange visibleRange(const vec4 &view, GLint width, GLint height) const {
+        GLint uMin = static_cast<GLint>(std::floor(view.x / (tileSize.x / 2.0f) - 2.0f)) + 1;
+        GLint uMax = static_cast<GLint>(std::ceil(view.z / (tileSize.x / 2.0f))) - 1;
+        GLint vMin = static_cast<GLint>(std::floor(view.y / (tileSize.y / 2.0f) - 2.0f)) + 1;
+        GLint vMax = static_cast<GLint>(std::ceil(view.w / (tileSize.y / 2.0f))) - 1;
+
+        VisibleRange range;
+        if (uMin > uMax || vMin > vMax) {
+            return range;
+        }
+
+        // 2i = v - u, so the rows come from the extremes of both intervals
+        range.firstRow = std::max(0, floorDiv2(vMin - uMax + 1));
+        range.lastRow = std::min(height, floorDiv2(vMax - uMin) + 1);
+        if (range.firstRow >= range.lastRow) {
+            range.lastRow = range.firstRow;
+            return range;
+        }
+
+        range.spans.reserve(range.lastRow - range.firstRow);
+        for (GLint i = range.firstRow; i < range.lastRow; i++) {
+            GLint begin = std::max({0, uMin + i, vMin - i});
+            GLint end = std::min({width, uMax + i + 1, vMax - i + 1});
+            range.spans.push_back({begin, std::max(begin, end)});
+        }
+        return range;
+    }
+
+private:
+    static GLint floorDiv2(GLint value) {
+        return value >= 0 ? value / 2 : -((-value + 1) / 2);
+    }
+};
+
+// Move-only owner of a GL object name; Traits provide glGen*/glDelete*
+template<typename Traits>
+class GLObject {
+private:
+    GLuint id = 0;
+
+public:
+    GLObject() = default;
+
+    static GLObject create() {
+        GLObject object;
+        Traits::create(object.id);
+        return object;
+    }
+
+    GLObject(const GLObject &) = delete;
+    GLObject &operator=(const GLObject &) = delete;
+
+    GLObject(GLObject &&other) noexcept : id(other.id) {
+        other.id = 0;
+    }
+
+    GLObject &operator=(GLObject &&other) noexcept {
+        if (this != &other) {
+            reset();
+            id = other.id;
+            other.id = 0;
+        }
+        return *this;
+    }
+
+    ~GLObject() {
+        reset();
+    }
+
+    GLvoid reset() {
+        if (id != 0) {
+            Traits::destroy(id);
+            id = 0;
+        }
+    }
+
+    GLuint get() const {
+        return id;
+    }
+};
+
+struct BufferTraits {
+    static GLvoid create(GLuint &id) { glGenBuffers(1, &id); }
+    static GLvoid destroy(GLuint id) { glDeleteBuffers(1, &id); }
+};
+
+struct VertexArrayTraits {
+    static GLvoid create(GLuint &id) { glGenVertexArrays(1, &id); }
+    static GLvoid destroy(GLuint id) { glDeleteVertexArrays(1, &id); }
+};
+
+struct TextureTraits {
+    static GLvoid create(GLuint &id) { glGenTextures(1, &id); }
+    static GLvoid destroy(GLuint id) { glDeleteTextures(1, &id); }
+};
+
+using GLBuffer = GLObject<BufferTraits>;
+using GLVertexArray = GLObject<VertexArrayTraits>;
+using GLTexture = GLObject<TextureTraits>;
+
+struct FramebufferTraits {
+    static GLvoid create(GLuint &id) { glGenFramebuffers(1, &id); }
+    static GLvoid destroy(GLuint id) { glDeleteFramebuffers(1, &id); }
+};
+
+struct RenderbufferTraits {
+    static GLvoid create(GLuint &id) { glGenRenderbuffers(1, &id); }
+    static GLvoid destroy(GLuint id) { glDeleteRenderbuffers(1, &id); }
+};
+
+using GLFramebuffer = GLObject<FramebufferTraits>;
+using GLRenderbuffer = GLObject<RenderbufferTraits>;
+
+// Render target standing in for the default framebuffer in headless mode. Frames
+// are drawn into a multisampled framebuffer (matching the windowed GLFW_SAMPLES)
+// and resolved into a single-sampled one that can be read back.
+class OffscreenTarget {
+private:
+    GLFramebuffer drawFramebuffer;
+    GLRenderbuffer colorBuffer;
+    GLRenderbuffer depthBuffer;
+    GLFramebuffer resolveFramebuffer;
+    GLRenderbuffer resolveBuffer;
+    const GLsizei width;
+    const GLsizei height;
+
+public:
+    OffscreenTarget(GLsizei width, GLsizei height, GLsizei samples) : width(width), height(height) {
+        GLint maxSamples = 0;
+        glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+        samples = std::min(samples, static_cast<GLsizei>(maxSamples));
+
+        colorBuffer = GLRenderbuffer::create();
+        glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer.get());
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+        depthBuffer = GLRenderbuffer::create();
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer.get());
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, width, height);
+        drawFramebuffer = GLFramebuffer::create();
+        glBindFramebuffer(GL_FRAMEBUFFER, drawFramebuffer.get());
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer.get());
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer.get());
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            throw runtime_error("Falha ao criar o framebuffer offscreen");
+        }
+
+        resolveBuffer = GLRenderbuffer::create();
+        glBindRenderbuffer(GL_RENDERBUFFER, resolveBuffer.get());
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        resolveFramebuffer = GLFramebuffer::create();
+        glBindFramebuffer(GL_FRAMEBUFFER, resolveFramebuffer.get());
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolveBuffer.get());
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            throw runtime_error("Falha ao criar o framebuffer offscreen");
+        }
+
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, drawFramebuffer.get());
+    }
+
+    // Resolves the finished frame; the draw framebuffer stays bound for the next one
+    GLvoid present() const {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, drawFramebuffer.get());
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFramebuffer.get());
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, drawFramebuffer.get());
+    }
+
+    // RGBA rows of the last presented frame, bottom row first
+    GLvoid readPixels(vector<GLubyte> &pixels) const {
+        pixels.resize(static_cast<size_t>(width) * height * 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, resolveFramebuffer.get());
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glBindFramebuffer(GL_FRAMEBUFFER, drawFramebuffer.get());
+    }
+
+    ivec2 getSize() const {
+        return ivec2(width, height);
+    }
+};
+
+// GLFW window and context. In headless mode the window stays hidden and every
+// frame goes to an OffscreenTarget instead, so the renderer runs unchanged in
+// batch jobs; without a display server GLFW's null platform provides the context
+// through surfaceless EGL, or OSMesa where EGL is missing (e.g. Mesa llvmpipe).
+class Window {
+private:
+    static constexpr GLint SAMPLES = 8;
+
+    GLFWwindow *window;
+    const GLuint width;
+    const GLuint height;
+    unique_ptr<OffscreenTarget> offscreen;
+
+public:
+    Window(GLuint width, GLuint height, const GLchar *title, GLboolean headless = false) : width(width), height(height) {
+#ifdef GLFW_PLATFORM_NULL
+        const GLboolean nullPlatform = headless && !getenv("DISPLAY") && !getenv("WAYLAND_DISPLAY") &&
+                                       glfwPlatformSupported(GLFW_PLATFORM_NULL);
+        if (nullPlatform) {
+            glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+        }
+#else
+        const GLboolean nullPlatform = false;
+#endif
+        if (!glfwInit()) {
+            throw runtime_error("Falha ao inicializar GLFW");
+        }
+        glfwWindowHint(GLFW_SAMPLES, SAMPLES);
+        if (headless) {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        }
+
+        window = glfwCreateWindow(width, height, title, nullptr, nullptr);
+        if (!window && nullPlatform) {
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+            window = glfwCreateWindow(width, height, title, nullptr, nullptr);
+        }
+        if (!window) {
+            glfwTerminate();
+            throw runtime_error("Falha ao criar a janela GLFW");
+        }
+
+        glfwMakeContextCurrent(window);
+
+        if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
+            throw runtime_error("Falha ao inicializar GLAD");
+        }
+
+        if (headless) {
+            offscreen = make_unique<OffscreenTarget>(width, height, SAMPLES);
+        }
+
+        ivec2 framebuffer = getFramebufferSize();
+        glViewport(0, 0, framebuffer.x, framebuffer.y);
+    }
+
+    ~Window() {
+        // The offscreen objects need the context, so they go before the window
+        offscreen.reset();
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+
+    GLboolean shouldClose() const {
+        return glfwWindowShouldClose(window);
+    }
+
+    // Headless frames are resolved instead of swapped; the flush keeps the GPU
+    // busy with them like a swap would
+    GLvoid swapBuffers() const {
+        if (offscreen) {
+            offscreen->present();
+            glFlush();
+        } else {
+            glfwSwapBuffers(window);
+        }
+    }
+
+    GLvoid setSwapInterval(GLint interval) const {
+        glfwSwapInterval(interval);
+    }
+
+    GLFWwindow *getHandle() const {
+        return window;
+    }
+
+    GLboolean isHeadless() const {
+        return offscreen != nullptr;
+    }
+
+    // Saves the last presented headless frame as a PNG
+    GLvoid saveFrame(const string &path) const {
+        if (!offscreen) {
+            throw runtime_error("Captura de quadros requer o modo headless");
+        }
+        vector<GLubyte> pixels;
+        offscreen->readPixels(pixels);
+        ivec2 size = offscreen->getSize();
+        PngWriter::write(path, size.x, size.y, pixels.data(), true);
+    }
+
+    ivec2 getFramebufferSize() const {
+        if (offscreen) {
+            return offscreen->getSize();
+        }
+        GLint fbWidth, fbHeight;
+        glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+        return ivec2(fbWidth, fbHeight);
+    }
+};
+
+// Unit diamond (x, y, z, s, t) drawn as a 4-vertex triangle strip. Texture
+// coordinates span the whole quad; the atlas rectangle of each tile type maps
+// them into the tileset in vertex.vert.
+class QuadMesh {
+private:
+    GLBuffer vertexBuffer;
+    GLVertexArray vertexArray;
+
+public:
+    static constexpr GLsizei VERTEX_COUNT = 4;
+
+    QuadMesh() {
+        GLfloat vertices[] = {
+            // x    y     z     s     t
+            0.0f, 0.5f, 0.0f, 0.0f, 0.5f, // A (topo)
+            0.5f, 1.0f, 0.0f, 0.5f, 1.0f, // B (direita)
+            0.5f, 0.0f, 0.0f, 0.5f, 0.0f, // D (base)
+            1.0f, 0.5f, 0.0f, 1.0f, 0.5f // C (esquerda)
+        };
+
+        vertexBuffer = GLBuffer::create();
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer.get());
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+        vertexArray = GLVertexArray::create();
+        glBindVertexArray(vertexArray.get());
+        bindAttributes();
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Sets up attributes 0 (position) and 1 (texture coordinate) on the bound VAO
+    GLvoid bindAttributes() const {
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer.get());
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid *) 0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid *) (3 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(1);
+    }
+
+    // VAO with only the quad attributes, for single draws
+    GLuint getVertexArray() const {
+        return vertexArray.get();
+    }
+};
+
+// Cache of the GL state the draw code touches. Every setter skips the GL call when
+// the requested state is already current and counts what it saved. The cache starts
+// out unknown, so the first call for each piece of state always reaches GL; code that
+// changes this state behind the tracker's back must call invalidate().
+class RenderState {
+private:
+    static constexpr GLuint UNKNOWN = ~0u;
+    static constexpr GLuint MAX_TEXTURE_UNITS = 16;
+
+    GLuint program = UNKNOWN;
+    GLuint vertexArray = UNKNOWN;
+    GLuint arrayBuffer = UNKNOWN;
+    GLuint activeUnit = UNKNOWN;
+    array<GLuint, MAX_TEXTURE_UNITS> texture2D{};
+    array<GLuint, MAX_TEXTURE_UNITS> texture2DArray{};
+    GLint blend = -1;
+    GLenum blendSrc = 0, blendDst = 0;
+    GLint depthTest = -1;
+    GLenum depthFunc = 0;
+
+    GLuint64 issued = 0;
+    GLuint64 skipped = 0;
+
+public:
+    RenderState() {
+        invalidate();
+    }
+
+    GLvoid invalidate() {
+        program = vertexArray = arrayBuffer = activeUnit = UNKNOWN;
+        texture2D.fill(UNKNOWN);
+        texture2DArray.fill(UNKNOWN);
+        blend = depthTest = -1;
+        blendSrc = blendDst = depthFunc = 0;
+    }
+
+    GLvoid useProgram(GLuint id) {
+        if (changed(program, id)) {
+            glUseProgram(id);
+        }
+    }
+
+    GLvoid bindVertexArray(GLuint id) {
+        if (changed(vertexArray, id)) {
+            glBindVertexArray(id);
+        }
+    }
+
+    GLvoid bindArrayBuffer(GLuint id) {
+        if (changed(arrayBuffer, id)) {
+            glBindBuffer(GL_ARRAY_BUFFER, id);
+        }
+    }
+
+    // GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY on the given unit
+    GLvoid bindTexture(GLuint unit, GLenum target, GLuint id) {
+        GLuint &bound = (target == GL_TEXTURE_2D_ARRAY ? texture2DArray : texture2D)[unit];
+        if (!changed(bound, id)) {
+            return;
+        }
+        if (changed(activeUnit, unit)) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+        }
+        glBindTexture(target, id);
+    }
+
+    GLvoid setBlend(GLboolean enabled) {
+        if (changed(blend, enabled ? 1 : 0)) {
+            enabled ? glEnable(GL_BLEND) : glDisable(GL_BLEND);
+        }
+    }
+
+    GLvoid setBlendFunc(GLenum src, GLenum dst) {
+        if (blendSrc == src && blendDst == dst) {
+            skipped++;
+            return;
+        }
+        blendSrc = src;
+        blendDst = dst;
+        issued++;
+        glBlendFunc(src, dst);
+    }
+
+    GLvoid setDepthTest(GLboolean enabled) {
+        if (changed(depthTest, enabled ? 1 : 0)) {
+            enabled ? glEnable(GL_DEPTH_TEST) : glDisable(GL_DEPTH_TEST);
+        }
+    }
+
+    GLvoid setDepthFunc(GLenum func) {
+        if (changed(depthFunc, func)) {
+            glDepthFunc(func);
+        }
+    }
+
+    // State changes that reached GL and the ones that were elided
+    GLuint64 getIssued() const {
+        return issued;
+    }
+
+    GLuint64 getSkipped() const {
+        return skipped;
+    }
+
+    GLvoid resetCounters() {
+        issued = skipped = 0;
+    }
+
+private:
+    template<typename T>
+    GLboolean changed(T &current, T requested) {
+        if (current == requested) {
+            skipped++;
+            return false;
+        }
+        current = requested;
+        issued++;
+        return true;
+    }
+};
+
+// Counters for one rendered frame
+struct FrameStats {
+    GLuint drawCalls = 0;
+    GLuint64 instances = 0;
+    GLuint uniformUploads = 0;
+    GLuint64 bufferBytes = 0;
+    GLuint64 stateChanges = 0;
+    double cpuTime = 0.0;
+    // GPU results arrive a few frames late; this is the latest one available
+    double gpuTime = 0.0;
+};
+
+// Render statistics. Draw paths add to the frame in progress; endFrame() publishes
+// it as the last complete frame, which is what code and the HUD read. Main thread
+// only.
+class RenderStats {
+private:
+    FrameStats current;
+    FrameStats last;
+    GLuint64 issuedAtStart = 0;
+    double latestGpuTime = 0.0;
+
+    RenderStats() = default;
+
+public:
+    static RenderStats &instance() {
+        static RenderStats stats;
+        return stats;
+    }
+
+    GLvoid countDraw(GLuint64 instances) {
+        current.drawCalls++;
+        current.instances += instances;
+    }
+
+    GLvoid countUniformUpload() {
+        current.uniformUploads++;
+    }
+
+    GLvoid countBufferUpload(GLuint64 bytes) {
+        current.bufferBytes += bytes;
+    }
+
+    GLvoid setGpuTime(double seconds) {
+        latestGpuTime = seconds;
+    }
+
+    GLvoid beginFrame(const RenderState &state) {
+        current = FrameStats();
+        issuedAtStart = state.getIssued();
+    }
+
+    GLvoid endFrame(const RenderState &state, double cpuTime) {
+        current.stateChanges = state.getIssued() - issuedAtStart;
+        current.cpuTime = cpuTime;
+        current.gpuTime = latestGpuTime;
+        last = current;
+    }
+
+    const FrameStats &getLastFrame() const {
+        return last;
+    }
+};
+
+// On-disk cache of linked program binaries (glGetProgramBinary/glProgramBinary,
+// GL 4.1 or ARB_get_program_binary), keyed by a hash of the shader sources, their
+// defines and the driver's renderer and version strings, so a driver update just
+// misses. The glad loader only covers GL 3.3, so the entry points are fetched
+// here. Also enables KHR_parallel_shader_compile when present, letting the driver
+// build several programs at once.
+class ProgramCache {
+private:
+    static constexpr GLenum PROGRAM_BINARY_RETRIEVABLE_HINT = 0x8257;
+    static constexpr GLenum PROGRAM_BINARY_LENGTH = 0x8741;
+    static constexpr GLenum NUM_PROGRAM_BINARY_FORMATS = 0x87FE;
+    static constexpr char MAGIC[4] = {'G', 'B', 'P', 'B'};
+
+    using GetProgramBinaryProc = void (APIENTRYP)(GLuint, GLsizei, GLsizei *, GLenum *, void *);
+    using ProgramBinaryProc = void (APIENTRYP)(GLuint, GLenum, const void *, GLsizei);
+    using ProgramParameteriProc = void (APIENTRYP)(GLuint, GLenum, GLint);
+    using MaxShaderCompilerThreadsProc = void (APIENTRYP)(GLuint);
+
+    GetProgramBinaryProc getProgramBinary = nullptr;
+    ProgramBinaryProc programBinary = nullptr;
+    ProgramParameteriProc programParameteri = nullptr;
+    GLboolean initialized = false;
+    GLboolean parallelCompile = false;
+    string driver;
+    const string directory = "shadercache";
+
+    ProgramCache() = default;
+
+public:
+    // Outcome of load(); only a rejected binary leaves the program unusable
+    enum class LoadResult : uint8_t { Missing, Loaded, Rejected };
+
+    static ProgramCache &instance() {
+        static ProgramCache cache;
+        return cache;
+    }
+
+    // FNV-1a over the given strings and the driver identity; strings are
+    // separated so ("ab", "c") and ("a", "bc") differ
+    uint64_t key(initializer_list<string_view> parts) {
+        initialize();
+        uint64_t hash = 0xCBF29CE484222325ull;
+        auto mix = [&hash](string_view text) {
+            for (char c: text) {
+                hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001B3ull;
+            }
+            hash = (hash ^ 0xFF) * 0x100000001B3ull;
+        };
+        for (string_view part: parts) {
+            mix(part);
+        }
+        mix(driver);
+        return hash;
+    }
+
+    GLboolean isEnabled() {
+        initialize();
+        return programBinary != nullptr;
+    }
+
+    // Links program from the cached binary. On a miss the program is left
+    // untouched; if the driver rejects the binary it is left in a failed state
+    LoadResult load(GLuint program, uint64_t key) {
+        if (!isEnabled()) {
+            return LoadResult::Missing;
+        }
+        ifstream file(pathFor(key), ios::binary);
+        if (!file.is_open()) {
+            return LoadResult::Missing;
+        }
+        char magic[4];
+        GLenum format = 0;
+        file.read(magic, sizeof(magic));
+        file.read(reinterpret_cast<char *>(&format), sizeof(format));
+        if (!file) {
+            return LoadResult::Missing;
+        }
+        vector<char> binary((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        if (memcmp(magic, MAGIC, sizeof(magic)) != 0 || binary.empty()) {
+            return LoadResult::Missing;
+        }
+
+        programBinary(program, format, binary.data(), static_cast<GLsizei>(binary.size()));
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        return linked == GL_TRUE ? LoadResult::Loaded : LoadResult::Rejected;
+    }
+
+    // Call before linking a program that store() will save
+    GLvoid markRetrievable(GLuint program) {
+        if (isEnabled()) {
+            programParameteri(program, PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+    }
+
+    GLvoid store(GLuint program, uint64_t key) {
+        if (!isEnabled()) {
+            return;
+        }
+        GLint length = 0;
+        glGetProgramiv(program, PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            return;
+        }
+        vector<char> binary(static_cast<size_t>(length));
+        GLenum format = 0;
+        getProgramBinary(program, length, &length, &format, binary.data());
+
+        // Written aside and renamed, so a crash never leaves a truncated entry
+        error_code error;
+        filesystem::create_directories(directory, error);
+        string path = pathFor(key);
+        string partial = path + ".tmp";
+        {
+            ofstream file(partial, ios::binary | ios::trunc);
+            file.write(MAGIC, sizeof(MAGIC));
+            file.write(reinterpret_cast<const char *>(&format), sizeof(format));
+            file.write(binary.data(), length);
+            if (!file) {
+                LOG_WARN("Could not write the shader cache entry {}", path);
+                return;
+            }
+        }
+        filesystem::rename(partial, path, error);
+    }
+
+private:
+    GLvoid initialize() {
+        if (initialized) {
+            return;
+        }
+        initialized = true;
+
+        driver = string(reinterpret_cast<const char *>(glGetString(GL_RENDERER))) + "|" +
+                 reinterpret_cast<const char *>(glGetString(GL_VERSION));
+
+        GLint formats = 0;
+        if (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 1) ||
+            glfwExtensionSupported("GL_ARB_get_program_binary")) {
+            glGetIntegerv(NUM_PROGRAM_BINARY_FORMATS, &formats);
+        }
+        if (formats > 0) {
+            getProgramBinary = reinterpret_cast<GetProgramBinaryProc>(glfwGetProcAddress("glGetProgramBinary"));
+            programBinary = reinterpret_cast<ProgramBinaryProc>(glfwGetProcAddress("glProgramBinary"));
+            programParameteri = reinterpret_cast<ProgramParameteriProc>(glfwGetProcAddress("glProgramParameteri"));
+            if (!getProgramBinary || !programBinary || !programParameteri) {
+                getProgramBinary = nullptr;
+                programBinary = nullptr;
+                programParameteri = nullptr;
+            }
+        }
+
+        if (glfwExtensionSupported("GL_KHR_parallel_shader_compile")) {
+            auto maxThreads = reinterpret_cast<MaxShaderCompilerThreadsProc>(
+                glfwGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+            if (maxThreads) {
+                // Let the driver pick the number of threads
+                maxThreads(0xFFFFFFFFu);
+                parallelCompile = true;
+            }
+        }
+        LOG_INFO("Shader program cache {}, parallel compile {}", programBinary ? "enabled" : "unavailable",
+                 parallelCompile ? "enabled" : "unavailable");
+    }
+
+    string pathFor(uint64_t key) const {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.bin", static_cast<unsigned long long>(key));
+        return directory + name;
+    }
+};
+
+// Typed reference to an active uniform of a Shader, resolved once after link.
+// A handle for a uniform the program does not use has slot -1 and is ignored.
+template<typename T>
+struct Uniform {
+    GLint slot = -1;
+};
+
+class Shader {
+private:
+    // Reflected active uniform with a shadow copy of the last value sent to GL
+    struct UniformSlot {
+        string name;
+        GLint location;
+        GLenum type;
+        GLint size;
+        array<unsigned char, sizeof(mat4)> value;
+    };
+
+    // Compile and link started by the constructor and checked on first use, so
+    // the driver can build several programs at the same time
+    struct PendingBuild {
+        AssetData vertexSource;
+        AssetData fragmentSource;
+        GLuint vertexShader;
+        GLuint fragmentShader;
+        uint64_t cacheKey;
+    };
+
+    GLuint ID;
+    mutable unique_ptr<PendingBuild> pending;
+    mutable vector<UniformSlot> uniforms;
+    mutable unordered_map<string, GLint> slotByName;
+    static constexpr const char *PROGRAM_LINK_ERROR = "ERROR::SHADER::PROGRAM::LINKING_FAILED\n";
+
+public:
+    // defines are inserted after the #version line of both stages
+    Shader(const GLchar *vertexPath, const GLchar *fragmentPath, const vector<string> &defines = {}) {
+        PROFILE_SCOPE("Shader compile");
+        AssetData vertexSource = applyDefines(Assets::instance().load(vertexPath), defines);
+        AssetData fragmentSource = applyDefines(Assets::instance().load(fragmentPath), defines);
+
+        ProgramCache &cache = ProgramCache::instance();
+        uint64_t cacheKey = cache.key({vertexSource.text(), fragmentSource.text()});
+        ID = glCreateProgram();
+        ProgramCache::LoadResult cached = cache.load(ID, cacheKey);
+        if (cached == ProgramCache::LoadResult::Loaded) {
+            LOG_DEBUG("Program {} + {} loaded from the shader cache", vertexPath, fragmentPath);
+            reflectUniforms();
+            return;
+        }
+        if (cached == ProgramCache::LoadResult::Rejected) {
+            // Start over from a clean program, the failed binary load stays on this one
+            glDeleteProgram(ID);
+            ID = glCreateProgram();
+        }
+
+        GLuint vertexShader = compileShader(vertexSource.text(), GL_VERTEX_SHADER);
+        GLuint fragmentShader = compileShader(fragmentSource.text(), GL_FRAGMENT_SHADER);
+        glAttachShader(ID, vertexShader);
+        glAttachShader(ID, fragmentShader);
+        cache.markRetrievable(ID);
+        glLinkProgram(ID);
+        pending = make_unique<PendingBuild>(PendingBuild{std::move(vertexSource), std::move(fragmentSource),
+                                                         vertexShader, fragmentShader, cacheKey});
+    }
+
+    ~Shader() {
+        if (pending) {
+            glDeleteShader(pending->vertexShader);
+            glDeleteShader(pending->fragmentShader);
+        }
+        glDeleteProgram(ID);
+    }
+
+    void use(RenderState &state) const {
+        finishBuild();
+        state.useProgram(ID);
+    }
+
+    void setMat4(const GLchar *name, const mat4 &matrix) const {
+        set(uniform<mat4>(name), matrix);
+    }
+
+    // Location from the table built after link, -1 if the uniform is not active
+    GLint getUniformLocation(const string &name) const {
+        finishBuild();
+        auto it = slotByName.find(name);
+        return it == slotByName.end() ? -1 : uniforms[it->second].location;
+    }
+
+    // Arrays are sent as given, without going through the shadow copy
+    void setArray(Uniform<vec4> handle, const vector<vec4> &values) const {
+        if (handle.slot < 0 || values.empty()) {
+            return;
+        }
+        const UniformSlot &slot = uniforms[handle.slot];
+        GLsizei count = std::min(slot.size, static_cast<GLint>(values.size()));
+        glUniform4fv(slot.location, count, value_ptr(values.front()));
+        RenderStats::instance().countUniformUpload();
+    }
+
+    template<typename T>
+    Uniform<T> uniform(const string &name) const {
+        finishBuild();
+        auto it = slotByName.find(name);
+        if (it == slotByName.end()) {
+            return {};
+        }
+        if (!acceptsType<T>(uniforms[it->second].type)) {
+            throw runtime_error("Tipo incompativel para o uniform " + name);
+        }
+        return {it->second};
+    }
+
+    // Sends the value only if it differs from the shadow copy; the program must be in use
+    template<typename T>
+    void set(Uniform<T> handle, const T &value) const {
+        if (handle.slot < 0) {
+            return;
+        }
+        UniformSlot &slot = uniforms[handle.slot];
+        if (memcmp(slot.value.data(), &value, sizeof(T)) == 0) {
+            return;
+        }
+        memcpy(slot.value.data(), &value, sizeof(T));
+        upload(slot.location, value);
+        RenderStats::instance().countUniformUpload();
+    }
+
+    GLuint getProgram() const {
+        finishBuild();
+        return ID;
+    }
+
+private:
+    // Waits for the build started by the constructor, reports its errors and
+    // stores the linked binary in the cache
+    void finishBuild() const {
+        if (!pending) {
+            return;
+        }
+        unique_ptr<PendingBuild> build = std::move(pending);
+        checkCompileStatus(build->vertexShader, GL_VERTEX_SHADER, build->vertexSource.text());
+        checkCompileStatus(build->fragmentShader, GL_FRAGMENT_SHADER, build->fragmentSource.text());
+        checkProgramLinkStatus(ID);
+        glDeleteShader(build->vertexShader);
+        glDeleteShader(build->fragmentShader);
+
+        reflectUniforms();
+        ProgramCache::instance().store(ID, build->cacheKey);
+    }
+
+    // Without defines the source stays a zero-copy span
+    static AssetData applyDefines(AssetData source, const vector<string> &defines) {
+        if (defines.empty()) {
+            return source;
+        }
+        string block;
+        for (const string &define: defines) {
+            block += "#define " + define + "\n";
+        }
+        string_view text = source.text();
+        size_t lineEnd = text.substr(0, 8) == "#version" ? text.find('\n') : string_view::npos;
+        size_t split = lineEnd == string_view::npos ? 0 : lineEnd + 1;
+
+        AssetData patched;
+        patched.owned.reserve(text.size() + block.size());
+        patched.owned.insert(patched.owned.end(), text.begin(), text.begin() + split);
+        patched.owned.insert(patched.owned.end(), block.begin(), block.end());
+        patched.owned.insert(patched.owned.end(), text.begin() + split, text.end());
+        patched.bytes = patched.owned;
+        return patched;
+    }
+
+    // Enumerates the active uniforms once; GL initializes them all to zero, and so
+    // does the shadow table
+    void reflectUniforms() const {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        vector<GLchar> nameBuffer(static_cast<size_t>(std::max(maxLength, 1)));
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, static_cast<GLuint>(i), maxLength, &length, &size, &type, nameBuffer.data());
+
+            string name(nameBuffer.data(), static_cast<size_t>(length));
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+                name.resize(name.size() - 3);
+            }
+            GLint location = glGetUniformLocation(ID, name.c_str());
+            if (location < 0) {
+                continue; // uniform block member
+            }
+
+            slotByName[name] = static_cast<GLint>(uniforms.size());
+            uniforms.push_back({name, location, type, size, {}});
+        }
+    }
+
+    template<typename T>
+    static GLboolean acceptsType(GLenum type) {
+        if constexpr (std::is_same_v<T, GLint>) {
+            return type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_2D || type == GL_SAMPLER_2D_ARRAY;
+        } else if constexpr (std::is_same_v<T, GLfloat>) {
+            return type == GL_FLOAT;
+        } else if constexpr (std::is_same_v<T, vec2>) {
+            return type == GL_FLOAT_VEC2;
+        } else if constexpr (std::is_same_v<T, vec4>) {
+            return type == GL_FLOAT_VEC4;
+        } else {
+            static_assert(std::is_same_v<T, mat4>, "Tipo de uniform nao suportado");
+            return type == GL_FLOAT_MAT4;
+        }
+    }
+
+    static void upload(GLint location, GLint value) {
+        glUniform1i(location, value);
+    }
+
+    static void upload(GLint location, GLfloat value) {
+        glUniform1f(location, value);
+    }
+
+    static void upload(GLint location, const vec2 &value) {
+        glUniform2fv(location, 1, value_ptr(value));
+    }
+
+    static void upload(GLint location, const vec4 &value) {
+        glUniform4fv(location, 1, value_ptr(value));
+    }
+
+    static void upload(GLint location, const mat4 &value) {
+        glUniformMatrix4fv(location, 1, GL_FALSE, value_ptr(value));
+    }
+
+    // Only submits the source; errors are reported by checkCompileStatus
+    static GLuint compileShader(string_view source, GLenum type) {
+        GLuint shader = glCreateShader(type);
+        const GLchar *sourcePtr = source.data();
+        GLint length = static_cast<GLint>(source.size());
+        glShaderSource(shader, 1, &sourcePtr, &length);
+        glCompileShader(shader);
+        return shader;
+    }
+
+    static void checkCompileStatus(GLuint shader, GLenum type, string_view source) {
+        GLint success;
+        GLchar infoLog[512];
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(shader, sizeof(infoLog), nullptr, infoLog);
+            string shaderTypeName = (type == GL_VERTEX_SHADER) ? "VERTEX" : "FRAGMENT";
+            cerr << "Shader source: " << source << endl;
+            throw runtime_error("ERROR::SHADER::" + shaderTypeName + "::COMPILATION_FAILED\n" + infoLog);
+        }
+    }
+
+    static void checkProgramLinkStatus(GLuint program) {
+        GLint success;
+        GLchar infoLog[512];
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            glGetProgramInfoLog(program, sizeof(infoLog), nullptr, infoLog);
+            throw runtime_error(string(PROGRAM_LINK_ERROR) + infoLog);
+        }
+    }
+};
+
+enum class PacingMode {
+    VSync,      // the swap blocks on the display refresh
+    Sleep,      // sleep until the frame deadline, then spin the last SPIN_TAIL seconds
+    WaitEvents, // like Sleep but blocks in glfwWaitEventsTimeout; idle scenes wait for input
+    Uncapped    // no pacing, for benchmarking
+};
+
+// Where a frame's wall time went: waiting for the deadline (or events), running the
+// frame, and inside the buffer swap
+struct FrameTiming {
+    double sleep = 0.0;
+    double work = 0.0;
+    double present = 0.0;
+
+    double total() const {
+        return sleep + work + present;
+    }
+};
+
+// Paces Game::run without busy-waiting. Each frame is waitForFrame() -> work ->
+// beginPresent() -> swap -> endPresent().
+class FrameScheduler {
+private:
+    using Clock = chrono::steady_clock;
+
+    // Sleeping is only accurate to about a millisecond, so the end of the wait spins
+    static constexpr double SPIN_TAIL = 0.0015;
+    // How long an idle scene blocks waiting for events in WaitEvents mode
+    static constexpr double IDLE_TIMEOUT = 0.5;
+
+    PacingMode mode;
+    double period;
+    Clock::time_point deadline;
+    Clock::time_point frameStart;
+    Clock::time_point presentStart;
+    GLboolean idle = false;
+
+    FrameTiming last;
+    FrameTiming accumulated;
+    GLuint64 frames = 0;
+
+public:
+    FrameScheduler(PacingMode mode, double targetFps) : mode(mode), period(1.0 / targetFps) {
+        deadline = frameStart = presentStart = Clock::now();
+    }
+
+    // Swap interval matching the mode; call once the context is current
+    GLvoid apply(const Window &window) const {
+        window.setSwapInterval(mode == PacingMode::VSync ? 1 : 0);
+    }
+
+    // Marks the scene as having nothing to animate, so WaitEvents mode can block
+    // until input arrives instead of redrawing
+    GLvoid setIdle(GLboolean sceneIdle) {
+        idle = sceneIdle;
+    }
+
+    // Waits for the next frame slot and processes window events
+    GLvoid waitForFrame() {
+        Clock::time_point waitStart = Clock::now();
+
+        switch (mode) {
+            case PacingMode::VSync:
+            case PacingMode::Uncapped:
+                glfwPollEvents();
+                break;
+            case PacingMode::Sleep:
+                sleepUntilDeadline();
+                glfwPollEvents();
+                break;
+            case PacingMode::WaitEvents:
+                if (idle) {
+                    glfwWaitEventsTimeout(IDLE_TIMEOUT);
+                } else {
+                    double remaining = secondsBetween(Clock::now(), deadline);
+                    if (remaining > SPIN_TAIL) {
+                        glfwWaitEventsTimeout(remaining - SPIN_TAIL);
+                    }
+                    sleepUntilDeadline();
+                    glfwPollEvents();
+                }
+                break;
+        }
+
+        frameStart = Clock::now();
+        last.sleep = secondsBetween(waitStart, frameStart);
+
+        // Schedule the next slot from the previous deadline so the rate holds on
+        // average, but don't try to catch up after a long stall
+        deadline += chrono::duration_cast<Clock::duration>(chrono::duration<double>(period));
+        if (deadline < frameStart) {
+            deadline = frameStart + chrono::duration_cast<Clock::duration>(chrono::duration<double>(period));
+        }
+    }
+
+    GLvoid beginPresent() {
+        presentStart = Clock::now();
+        last.work = secondsBetween(frameStart, presentStart);
+    }
+
+    GLvoid endPresent() {
+        last.present = secondsBetween(presentStart, Clock::now());
+        accumulated.sleep += last.sleep;
+        accumulated.work += last.work;
+        accumulated.present += last.present;
+        frames++;
+    }
+
+    const FrameTiming &getLastFrame() const {
+        return last;
+    }
+
+    // Mean per-frame timing since the scheduler started
+    FrameTiming getAverage() const {
+        FrameTiming average;
+        if (frames > 0) {
+            average.sleep = accumulated.sleep / frames;
+            average.work = accumulated.work / frames;
+            average.present = accumulated.present / frames;
+        }
+        return average;
+    }
+
+    GLuint64 getFrameCount() const {
+        return frames;
+    }
+
+    static const char *modeName(PacingMode mode) {
+        switch (mode) {
+            case PacingMode::VSync: return "vsync";
+            case PacingMode::Sleep: return "sleep";
+            case PacingMode::WaitEvents: return "wait";
+            case PacingMode::Uncapped: return "uncapped";
+        }
+        return "?";
+    }
+
+    static PacingMode parseMode(const string &name) {
+        for (PacingMode mode: {PacingMode::VSync, PacingMode::Sleep, PacingMode::WaitEvents, PacingMode::Uncapped}) {
+            if (name == modeName(mode)) {
+                return mode;
+            }
+        }
+        throw runtime_error("Modo de pacing desconhecido: " + name);
+    }
+
+    PacingMode getMode() const {
+        return mode;
+    }
+
+private:
+    GLvoid sleepUntilDeadline() const {
+        Clock::time_point spinFrom = deadline - chrono::duration_cast<Clock::duration>(chrono::duration<double>(SPIN_TAIL));
+        if (Clock::now() < spinFrom) {
+            this_thread::sleep_until(spinFrom);
+        }
+        while (Clock::now() < deadline) {
+            this_thread::yield();
+        }
+    }
+
+    static double secondsBetween(Clock::time_point from, Clock::time_point to) {
+        return chrono::duration<double>(to - from).count();
+    }
+};
+
+// Bounded single-producer/single-consumer ring. The producer only writes tail and
+// the consumer only writes head, so neither side ever blocks or locks.
+template<typename T, size_t N>
+class SpscQueue {
+private:
+    static_assert((N & (N - 1)) == 0, "A capacidade precisa ser potencia de 2");
+
+    array<T, N> items;
+    alignas(64) atomic<size_t> head{0};
+    alignas(64) atomic<size_t> tail{0};
+
+public:
+    // False when the queue is full
+    bool push(const T &item) {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - head.load(memory_order_acquire) == N) {
+            return false;
+        }
+        items[t & (N - 1)] = item;
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+
+    // Oldest item without removing it, nullptr when empty
+    const T *front() const {
+        size_t h = head.load(memory_order_relaxed);
+        if (h == tail.load(memory_order_acquire)) {
+            return nullptr;
+        }
+        return &items[h & (N - 1)];
+    }
+
+    GLvoid pop() {
+        head.store(head.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+};
+
+// A key transition as seen by the GLFW callback, stamped with glfwGetTime()
+struct InputEvent {
+    double time;
+    GLint key;
+    GLint action;
+};
+
+// Carries key events from the window callbacks to the simulation. Callbacks push
+// into an SPSC queue; each tick drains the events up to its own time, tracks which
+// of the repeated keys are held and repeats them every repeatInterval seconds.
+// Other keys only deliver their presses and releases. The delay between an event
+// and the tick that consumes it is recorded as input latency.
+class InputSystem {
+private:
+    static constexpr size_t QUEUE_SIZE = 256;
+
+    SpscQueue<InputEvent, QUEUE_SIZE> events;
+    vector<GLint> repeatedKeys;
+    array<double, GLFW_KEY_LAST + 1> nextRepeat;
+    double repeatInterval;
+    atomic<GLuint64> dropped{0};
+
+    double latencySum = 0.0;
+    double latencyMax = 0.0;
+    GLuint64 latencyCount = 0;
+
+public:
+    InputSystem(double repeatRate, span<const GLint> repeated) : repeatedKeys(repeated.begin(), repeated.end()),
+            repeatInterval(1.0 / repeatRate) {
+        nextRepeat.fill(-1.0);
+    }
+
+    // Producer side, called from the GLFW key callback. OS key repeats are ignored:
+    // repeating is done here at a fixed rate.
+    GLvoid push(GLint key, GLint action, double time) {
+        if (key < 0 || key > GLFW_KEY_LAST || action == GLFW_REPEAT) {
+            return;
+        }
+        if (!events.push({time, key, action})) {
+            dropped.fetch_add(1, memory_order_relaxed);
+        }
+    }
+
+    // Consumer side, once per tick. Calls onKey(key, action, eventTime) for each
+    // press and release that happened up to tickTime and for each due repeat
+    // (action GLFW_REPEAT) of a held key.
+    template<typename Handler>
+    GLvoid drain(double tickTime, double now, Handler &&onKey) {
+        while (const InputEvent *event = events.front()) {
+            if (event->time > tickTime) {
+                break;
+            }
+            InputEvent current = *event;
+            events.pop();
+
+            double latency = now - current.time;
+            latencySum += latency;
+            latencyMax = std::max(latencyMax, latency);
+            latencyCount++;
+
+            if (isRepeated(current.key)) {
+                nextRepeat[current.key] = current.action == GLFW_PRESS ? current.time + repeatInterval : -1.0;
+            }
+            onKey(current.key, current.action, current.time);
+        }
+
+        for (GLint key: repeatedKeys) {
+            if (nextRepeat[key] >= 0.0 && nextRepeat[key] <= tickTime) {
+                double repeatTime = nextRepeat[key];
+                nextRepeat[key] += repeatInterval;
+                onKey(key, GLFW_REPEAT, repeatTime);
+            }
+        }
+    }
+
+    GLboolean isRepeated(GLint key) const {
+        return std::find(repeatedKeys.begin(), repeatedKeys.end(), key) != repeatedKeys.end();
+    }
+
+    // Only repeated keys are tracked; any other key reads as released
+    GLboolean isHeld(GLint key) const {
+        return key >= 0 && key <= GLFW_KEY_LAST && nextRepeat[key] >= 0.0;
+    }
+
+    GLboolean anyHeld() const {
+        for (GLint key: repeatedKeys) {
+            if (nextRepeat[key] >= 0.0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Mean and worst delay from a callback to the tick that consumed it, in seconds
+    double getAverageLatency() const {
+        return latencyCount > 0 ? latencySum / static_cast<double>(latencyCount) : 0.0;
+    }
+
+    double getMaxLatency() const {
+        return latencyMax;
+    }
+
+    GLuint64 getDropped() const {
+        return dropped.load(memory_order_relaxed);
+    }
+};
+
+// Percentiles of a latency distribution, in seconds
+struct LatencyStats {
+    GLuint64 count = 0;
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+// Fixed-width histogram: BUCKET_WIDTH resolution up to BUCKET_COUNT * BUCKET_WIDTH,
+// anything slower lands in the last bucket
+class LatencyHistogram {
+private:
+    static constexpr double BUCKET_WIDTH = 0.00025;
+    static constexpr size_t BUCKET_COUNT = 2000;
+
+    array<GLuint64, BUCKET_COUNT> buckets{};
+    GLuint64 count = 0;
+    double sum = 0.0;
+    double max = 0.0;
+
+public:
+    GLvoid add(double seconds) {
+        seconds = std::max(seconds, 0.0);
+        size_t bucket = std::min(static_cast<size_t>(seconds / BUCKET_WIDTH), BUCKET_COUNT - 1);
+        buckets[bucket]++;
+        count++;
+        sum += seconds;
+        max = std::max(max, seconds);
+    }
+
+    // Upper edge of the bucket holding the given fraction of the samples
+    double percentile(double fraction) const {
+        if (count == 0) {
+            return 0.0;
+        }
+        GLuint64 rank = static_cast<GLuint64>(std::ceil(fraction * static_cast<double>(count)));
+        GLuint64 seen = 0;
+        for (size_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+            seen += buckets[bucket];
+            if (seen >= std::max<GLuint64>(rank, 1)) {
+                return std::min((bucket + 1) * BUCKET_WIDTH, max);
+            }
+        }
+        return max;
+    }
+
+    LatencyStats getStats() const {
+        LatencyStats stats;
+        stats.count = count;
+        if (count > 0) {
+            stats.mean = sum / static_cast<double>(count);
+            stats.p50 = percentile(0.50);
+            stats.p95 = percentile(0.95);
+            stats.p99 = percentile(0.99);
+            stats.max = max;
+        }
+        return stats;
+    }
+};
+
+// Input-to-photon latency. Each frame hands over the timestamps of the inputs whose
+// effect it is the first to show; a fence inserted right after the swap closes the
+// measurement once the GPU has finished that frame. Fences are only polled, never
+// waited on, so the measurement adds no stall (and is accurate to the polling
+// points: the end of each present and the start of each frame).
+class LatencyTracker {
+private:
+    struct PendingFrame {
+        GLsync fence;
+        vector<double> inputTimes;
+    };
+
+    vector<PendingFrame> pending;
+    LatencyHistogram histogram;
+
+public:
+    ~LatencyTracker() {
+        for (PendingFrame &frame: pending) {
+            glDeleteSync(frame.fence);
+        }
+    }
+
+    // Call right after swapping buffers with the inputs first shown by that frame
+    GLvoid frameSubmitted(vector<double> &inputTimes) {
+        if (inputTimes.empty()) {
+            return;
+        }
+        pending.push_back({glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), std::move(inputTimes)});
+        inputTimes.clear();
+    }
+
+    // Records every frame whose fence has signaled; never blocks
+    GLvoid poll(double now) {
+        size_t done = 0;
+        while (done < pending.size()) {
+            GLenum status = glClientWaitSync(pending[done].fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+                break;
+            }
+            for (double inputTime: pending[done].inputTimes) {
+                histogram.add(now - inputTime);
+            }
+            glDeleteSync(pending[done].fence);
+            done++;
+        }
+        pending.erase(pending.begin(), pending.begin() + static_cast<ptrdiff_t>(done));
+    }
+
+    LatencyStats getStats() const {
+        return histogram.getStats();
+    }
+};
+
+// 2D camera: the world point at the center of the viewport, a zoom factor and the
+// viewport size in pixels. The matrices are rebuilt and uploaded only after one of
+// them changes.
+class Camera {
+private:
+    vec2 position{0.0f};
+    vec2 offset{0.0f};
+    GLfloat zoom = 1.0f;
+    vec2 viewport{0.0f};
+
+    mat4 view;
+    mat4 projection;
+    GLboolean viewDirty = true;
+    GLboolean projectionDirty = true;
+    GLuint64 viewVersion = 1;
+    GLuint64 projectionVersion = 1;
+
+    // Matrix uniforms of each shader the camera feeds and the versions it last got
+    struct Binding {
+        const Shader *shader;
+        Uniform<mat4> view;
+        Uniform<mat4> projection;
+        GLuint64 viewVersion;
+        GLuint64 projectionVersion;
+    };
+
+    vector<Binding> bindings;
+
+public:
+    static constexpr GLfloat MIN_ZOOM = 0.125f;
+    static constexpr GLfloat MAX_ZOOM = 8.0f;
+
+    Camera(GLfloat viewportWidth, GLfloat viewportHeight) : view(1.0f), projection(1.0f) {
+        setViewport(viewportWidth, viewportHeight);
+    }
+
+    // Centers on a world point, keeping the offset added by pan()
+    GLvoid follow(const vec2 &target) {
+        setPosition(target + offset);
+    }
+
+    GLvoid pan(const vec2 &delta) {
+        offset += delta / zoom;
+        setPosition(position + delta / zoom);
+    }
+
+    GLvoid setPosition(const vec2 &newPosition) {
+        if (newPosition != position) {
+            position = newPosition;
+            viewDirty = true;
+        }
+    }
+
+    GLvoid setZoom(GLfloat newZoom) {
+        newZoom = std::clamp(newZoom, MIN_ZOOM, MAX_ZOOM);
+        if (newZoom != zoom) {
+            zoom = newZoom;
+            viewDirty = true;
+        }
+    }
+
+    GLvoid zoomBy(GLfloat factor) {
+        setZoom(zoom * factor);
+    }
+
+    GLvoid setViewport(GLfloat width, GLfloat height) {
+        vec2 size(width, height);
+        if (size != viewport) {
+            viewport = size;
+            viewDirty = true;
+            projectionDirty = true;
+        }
+    }
+
+    const mat4 &getView() {
+        if (viewDirty) {
+            // World -> pixels: move the camera position to the viewport center
+            view = translate(mat4(1.0f), vec3(viewport / 2.0f, 0.0f));
+            view = scale(view, vec3(zoom, zoom, 1.0f));
+            view = translate(view, vec3(-position, 0.0f));
+            viewDirty = false;
+            viewVersion++;
+        }
+        return view;
+    }
+
+    const mat4 &getProjection() {
+        if (projectionDirty) {
+            projection = ortho(0.0f, viewport.x, viewport.y, 0.0f, -1.0f, 1.0f);
+            projectionDirty = false;
+            projectionVersion++;
+        }
+        return projection;
+    }
+
+    const vec2 &getOffset() const {
+        return offset;
+    }
+
+    GLfloat getZoom() const {
+        return zoom;
+    }
+
+    // World rectangle (left, top, right, bottom) covered by the viewport
+    vec4 worldBounds() const {
+        vec2 halfExtent = viewport / (2.0f * zoom);
+        return vec4(position - halfExtent, position + halfExtent);
+    }
+
+    // Resolves the matrix uniforms of a shader the camera uploads to
+    GLvoid bind(const Shader &shader) {
+        bindings.push_back({&shader, shader.uniform<mat4>("view"), shader.uniform<mat4>("projection"), 0, 0});
+    }
+
+    // Makes the next apply() upload both matrices again, e.g. after something else
+    // set the same uniforms
+    GLvoid invalidate(const Shader &shader) {
+        for (Binding &binding: bindings) {
+            if (binding.shader == &shader) {
+                binding.viewVersion = 0;
+                binding.projectionVersion = 0;
+            }
+        }
+    }
+
+    // Uploads the matrices that changed since this shader last got them; the shader
+    // must be bound and in use
+    GLvoid apply(const Shader &shader) {
+        for (Binding &binding: bindings) {
+            if (binding.shader != &shader) {
+                continue;
+            }
+            getView();
+            getProjection();
+            if (binding.viewVersion != viewVersion) {
+                shader.set(binding.view, view);
+                binding.viewVersion = viewVersion;
+            }
+            if (binding.projectionVersion != projectionVersion) {
+                shader.set(binding.projection, projection);
+                binding.projectionVersion = projectionVersion;
+            }
+            return;
+        }
+    }
+};
+
+// Collects textured quads for a frame and draws them with as few calls as possible:
+// all vertices go to a streaming buffer in one upload (orphaned each frame so the
+// driver never waits on the previous frame), and a new draw call starts only where
+// the texture changes.
+class SpriteBatch {
+private:
+    struct SpriteVertex {
+        vec3 position;
+        vec2 uv;
+        GLubyte tint[4];
+    };
+
+    struct Sprite {
+        GLuint texture;
+        GLfloat depth;
+        vec2 position;
+        vec2 size;
+        vec4 uvRect;
+        vec4 tint;
+    };
+
+    vector<Sprite> sprites;
+    vector<SpriteVertex> vertices;
+    GLVertexArray vertexArray;
+    GLBuffer vertexBuffer;
+    GLBuffer indexBuffer;
+    size_t capacity = 0;
+    GLsizei drawCalls = 0;
+
+public:
+    SpriteBatch(size_t initialCapacity = 1024) {
+        vertexArray = GLVertexArray::create();
+        vertexBuffer = GLBuffer::create();
+        indexBuffer = GLBuffer::create();
+
+        glBindVertexArray(vertexArray.get());
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer.get());
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex), (GLvoid *) offsetof(SpriteVertex, position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex), (GLvoid *) offsetof(SpriteVertex, uv));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SpriteVertex), (GLvoid *) offsetof(SpriteVertex, tint));
+        glEnableVertexAttribArray(2);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer.get());
+        reserve(initialCapacity);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    GLvoid begin() {
+        sprites.clear();
+    }
+
+    // Queues a quad with its top-left corner at position. uvRect is (s, t, width,
+    // height) with t at the top edge; a negative height flips the image vertically.
+    // Lower depth is drawn first.
+    GLvoid draw(GLuint texture, const vec2 &position, const vec2 &size, const vec4 &uvRect,
+                const vec4 &tint = vec4(1.0f), GLfloat depth = 0.0f) {
+        sprites.push_back({texture, depth, position, size, uvRect, tint});
+    }
+
+    // Sorts by depth, uploads every vertex once and issues one draw per texture run.
+    // The shader must be in use.
+    GLvoid end(RenderState &state) {
+        drawCalls = 0;
+        if (sprites.empty()) {
+            return;
+        }
+
+        stable_sort(sprites.begin(), sprites.end(), [](const Sprite &a, const Sprite &b) {
+            return a.depth < b.depth;
+        });
+
+        state.bindVertexArray(vertexArray.get());
+        state.bindArrayBuffer(vertexBuffer.get());
+        if (sprites.size() > capacity) {
+            reserve(std::max(sprites.size(), capacity * 2));
+        }
+
+        vertices.clear();
+        for (const Sprite &sprite: sprites) {
+            appendQuad(sprite);
+        }
+
+        glBufferData(GL_ARRAY_BUFFER, capacity * 4 * sizeof(SpriteVertex), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(SpriteVertex), vertices.data());
+        RenderStats::instance().countBufferUpload(vertices.size() * sizeof(SpriteVertex));
+
+        size_t first = 0;
+        for (size_t n = 1; n <= sprites.size(); n++) {
+            if (n == sprites.size() || sprites[n].texture != sprites[first].texture) {
+                state.bindTexture(0, GL_TEXTURE_2D, sprites[first].texture);
+                glDrawElements(GL_TRIANGLES, static_cast<GLsizei>((n - first) * 6), GL_UNSIGNED_INT,
+                               (GLvoid *) (first * 6 * sizeof(GLuint)));
+                RenderStats::instance().countDraw(n - first);
+                drawCalls++;
+                first = n;
+            }
+        }
+    }
+
+    size_t getSpriteCount() const {
+        return sprites.size();
+    }
+
+    GLsizei getDrawCalls() const {
+        return drawCalls;
+    }
+
+private:
+    // Index buffer for quadCount quads: two triangles over four vertices each. The
+    // batch's VAO must be bound.
+    GLvoid reserve(size_t quadCount) {
+        vector<GLuint> indices;
+        indices.reserve(quadCount * 6);
+        for (GLuint quad = 0; quad < quadCount; quad++) {
+            GLuint base = quad * 4;
+            indices.insert(indices.end(), {base, base + 1, base + 2, base + 2, base + 1, base + 3});
+        }
+
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+        RenderStats::instance().countBufferUpload(indices.size() * sizeof(GLuint));
+
+        capacity = quadCount;
+        vertices.reserve(quadCount * 4);
+    }
+
+    GLvoid appendQuad(const Sprite &sprite) {
+        // Textures have premultiplied alpha, so the tint is premultiplied too
+        vec4 color = glm::clamp(sprite.tint, 0.0f, 1.0f);
+        color = vec4(vec3(color) * color.a, color.a);
+        GLubyte tint[4];
+        for (int c = 0; c < 4; c++) {
+            tint[c] = static_cast<GLubyte>(color[c] * 255.0f + 0.5f);
+        }
+
+        vec2 corner = sprite.position;
+        vec2 uv = vec2(sprite.uvRect.x, sprite.uvRect.y);
+        vec2 uvSize = vec2(sprite.uvRect.z, sprite.uvRect.w);
+        // top-left, top-right, bottom-left, bottom-right
+        for (int v = 0; v < 4; v++) {
+            vec2 unit(static_cast<GLfloat>(v & 1), static_cast<GLfloat>(v >> 1));
+            SpriteVertex vertex{};
+            vertex.position = vec3(corner + unit * sprite.size, sprite.depth);
+            vertex.uv = uv + unit * uvSize;
+            memcpy(vertex.tint, tint, sizeof(tint));
+            vertices.push_back(vertex);
+        }
+    }
 };
 
-class Window {
+// Screen-space text in a built-in 5x7 bitmap font (upper case, digits and some
+// punctuation; lower case is drawn as upper case). Glyphs and a solid cell for
+// panels share one small texture, so everything queued between begin() and end()
+// goes out as a single SpriteBatch draw call.
+class TextRenderer {
 private:
-    GLFWwindow *window;
-    const GLuint width;
-    const GLuint height;
+    static constexpr GLint GLYPH_WIDTH = 5;
+    static constexpr GLint GLYPH_HEIGHT = 7;
+    // Each glyph sits in a cell with one texel of spacing to its right and below
+    static constexpr GLint CELL_WIDTH = GLYPH_WIDTH + 1;
+    static constexpr GLint CELL_HEIGHT = GLYPH_HEIGHT + 1;
+    static constexpr const char *CHARACTERS = " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:/%-(),=";
+    // Rows of each glyph in CHARACTERS, top first, bit 4 leftmost
+    static constexpr GLubyte GLYPHS[][GLYPH_HEIGHT] = {
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // space
+        {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}, // 0
+        {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E},
+        {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F},
+        {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E},
+        {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02},
+        {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E},
+        {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E},
+        {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08},
+        {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E},
+        {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}, // 9
+        {0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11}, // A
+        {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E},
+        {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E},
+        {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C},
+        {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F},
+        {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10},
+        {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F},
+        {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11},
+        {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E},
+        {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C},
+        {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11},
+        {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F},
+        {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11},
+        {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11},
+        {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E},
+        {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10},
+        {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D},
+        {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11},
+        {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E},
+        {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04},
+        {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E},
+        {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04},
+        {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A},
+        {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11},
+        {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04},
+        {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F}, // Z
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C}, // .
+        {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00}, // :
+        {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}, // /
+        {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03}, // %
+        {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00}, // -
+        {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02}, // (
+        {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08}, // )
+        {0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08}, // ,
+        {0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00}, // =
+    };
+    static constexpr GLint GLYPH_COUNT = sizeof(GLYPHS) / sizeof(GLYPHS[0]);
+    // The solid cell follows the glyphs
+    static constexpr GLint ATLAS_WIDTH = (GLYPH_COUNT + 1) * CELL_WIDTH;
+
+    GLTexture texture;
+    SpriteBatch batch;
+    array<GLint, 128> glyphIndex{};
 
 public:
-    Window(GLuint width, GLuint height, const GLchar *title) : width(width), height(height) {
-        glfwInit();
-        glfwWindowHint(GLFW_SAMPLES, 8);
+    explicit TextRenderer(RenderState &state) {
+        static_assert(GLYPH_COUNT == string_view(CHARACTERS).size(), "Um glifo por caractere");
 
-        window = glfwCreateWindow(width, height, title, nullptr, nullptr);
-        if (!window) {
-            throw runtime_error("Falha ao criar a janela GLFW");
+        vector<GLubyte> texels(static_cast<size_t>(ATLAS_WIDTH) * CELL_HEIGHT * 4, 0);
+        auto setTexel = [&texels](GLint x, GLint y) {
+            GLubyte *texel = &texels[(static_cast<size_t>(y) * ATLAS_WIDTH + x) * 4];
+            texel[0] = texel[1] = texel[2] = texel[3] = 255;
+        };
+        for (GLint glyph = 0; glyph < GLYPH_COUNT; glyph++) {
+            glyphIndex[static_cast<unsigned char>(CHARACTERS[glyph])] = glyph;
+            for (GLint y = 0; y < GLYPH_HEIGHT; y++) {
+                for (GLint x = 0; x < GLYPH_WIDTH; x++) {
+                    if (GLYPHS[glyph][y] & (0x10 >> x)) {
+                        setTexel(glyph * CELL_WIDTH + x, y);
+                    }
+                }
+            }
+        }
+        for (GLint y = 0; y < CELL_HEIGHT; y++) {
+            for (GLint x = 0; x < CELL_WIDTH; x++) {
+                setTexel(GLYPH_COUNT * CELL_WIDTH + x, y);
+            }
         }
 
-        glfwMakeContextCurrent(window);
+        texture = GLTexture::create();
+        state.bindTexture(0, GL_TEXTURE_2D, texture.get());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, ATLAS_WIDTH, CELL_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
 
-        if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
-            throw runtime_error("Falha ao inicializar GLAD");
+    GLvoid begin() {
+        batch.begin();
+    }
+
+    // Size in pixels of text drawn at the given scale; lines are split by '\n'
+    static vec2 measure(string_view text, GLfloat scale) {
+        GLint columns = 0, lines = 1, column = 0;
+        for (char c: text) {
+            if (c == '\n') {
+                lines++;
+                column = 0;
+            } else {
+                columns = std::max(columns, ++column);
+            }
         }
+        return vec2(columns * CELL_WIDTH, lines * CELL_HEIGHT) * scale;
+    }
 
-        GLint fbWidth, fbHeight;
-        glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
-        glViewport(0, 0, fbWidth, fbHeight);
+    // Queues text with its top-left corner at position (pixels); characters
+    // without a glyph are left blank
+    GLvoid text(string_view text, vec2 position, GLfloat scale, const vec4 &color) {
+        vec2 cursor = position;
+        for (char c: text) {
+            if (c == '\n') {
+                cursor = vec2(position.x, cursor.y + CELL_HEIGHT * scale);
+                continue;
+            }
+            unsigned char code = static_cast<unsigned char>(toupper(static_cast<unsigned char>(c)));
+            GLint glyph = code < glyphIndex.size() ? glyphIndex[code] : 0;
+            if (glyph != 0) {
+                batch.draw(texture.get(), cursor, vec2(GLYPH_WIDTH, GLYPH_HEIGHT) * scale, cellRect(glyph), color);
+            }
+            cursor.x += CELL_WIDTH * scale;
+        }
     }
 
-    ~Window() {
-        glfwDestroyWindow(window);
-        glfwTerminate();
+    // Queues a solid rectangle, e.g. a panel behind text
+    GLvoid rectangle(vec2 position, vec2 size, const vec4 &color) {
+        vec4 rect = cellRect(GLYPH_COUNT);
+        // Sample the middle of the solid cell so filtering never reaches a glyph
+        batch.draw(texture.get(), position, size, vec4(rect.x + rect.z / 2.0f, rect.y + rect.w / 2.0f, 0.0f, 0.0f), color);
     }
 
-    GLboolean shouldClose() const {
-        return glfwWindowShouldClose(window);
+    // Draws everything queued; the shader must be in use with a pixel projection
+    GLvoid end(RenderState &state) {
+        batch.end(state);
     }
 
-    GLvoid swapBuffers() const {
-        glfwSwapBuffers(window);
+private:
+    static vec4 cellRect(GLint cell) {
+        return vec4(static_cast<GLfloat>(cell * CELL_WIDTH) / ATLAS_WIDTH, 0.0f,
+                    static_cast<GLfloat>(GLYPH_WIDTH) / ATLAS_WIDTH, static_cast<GLfloat>(GLYPH_HEIGHT) / CELL_HEIGHT);
     }
+};
 
-    GLFWwindow *getHandle() const {
-        return window;
+// On-screen render statistics, toggled with F3. It shows the last complete frame,
+// taken before the overlay itself is drawn, and costs one draw call.
+class StatsHud {
+private:
+    static constexpr GLfloat SCALE = 2.0f;
+    static constexpr GLfloat MARGIN = 8.0f;
+
+    const Shader &shader;
+    Uniform<mat4> projection;
+    Uniform<mat4> view;
+    TextRenderer text;
+    GLboolean visible = false;
+
+public:
+    // Draws with the sprite shader, whose matrices it replaces while visible
+    StatsHud(RenderState &state, const Shader &spriteShader) : shader(spriteShader), text(state) {
+        projection = shader.uniform<mat4>("projection");
+        view = shader.uniform<mat4>("view");
+    }
+
+    GLvoid toggle() {
+        visible = !visible;
+    }
+
+    GLboolean isVisible() const {
+        return visible;
+    }
+
+    GLvoid draw(RenderState &state, const FrameStats &stats, const FrameTiming &timing, ivec2 framebuffer) {
+        if (!visible) {
+            return;
+        }
+
+        char lines[320];
+        snprintf(lines, sizeof(lines),
+                 "FPS %.1f  FRAME %.2f MS\n"
+                 "CPU %.2f MS  GPU %.2f MS\n"
+                 "DRAWS %u  INSTANCES %llu\n"
+                 "UNIFORMS %u  STATE CHANGES %llu\n"
+                 "UPLOADED %.1f KB",
+                 timing.total() > 0.0 ? 1.0 / timing.total() : 0.0, timing.total() * 1000.0,
+                 stats.cpuTime * 1000.0, stats.gpuTime * 1000.0,
+                 stats.drawCalls, static_cast<unsigned long long>(stats.instances),
+                 stats.uniformUploads, static_cast<unsigned long long>(stats.stateChanges),
+                 static_cast<double>(stats.bufferBytes) / 1024.0);
+
+        shader.use(state);
+        shader.set(projection, ortho(0.0f, static_cast<GLfloat>(framebuffer.x), static_cast<GLfloat>(framebuffer.y),
+                                     0.0f, -1.0f, 1.0f));
+        shader.set(view, mat4(1.0f));
+
+        vec2 size = TextRenderer::measure(lines, SCALE);
+        text.begin();
+        text.rectangle(vec2(MARGIN / 2.0f), size + vec2(MARGIN), vec4(0.0f, 0.0f, 0.0f, 0.6f));
+        text.text(lines, vec2(MARGIN), SCALE, vec4(1.0f));
+        text.end(state);
     }
 };
 
-class Shader {
+// Fixed set of threads running submitted jobs in FIFO order. Jobs still queued
+// when the pool stops are discarded.
+class WorkerPool {
 private:
-    GLuint ID;
-    static constexpr const char *PROGRAM_LINK_ERROR = "ERROR::SHADER::PROGRAM::LINKING_FAILED\n";
+    vector<thread> threads;
+    mutex jobsMutex;
+    condition_variable jobsReady;
+    deque<function<void()>> jobs;
+    GLboolean stopping = false;
+
+public:
+    explicit WorkerPool(size_t count) {
+        for (size_t n = 0; n < std::max<size_t>(count, 1); n++) {
+            threads.emplace_back([this] { work(); });
+        }
+    }
+
+    ~WorkerPool() {
+        stop();
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    GLvoid submit(function<void()> job) {
+        {
+            lock_guard<mutex> lock(jobsMutex);
+            jobs.push_back(std::move(job));
+        }
+        jobsReady.notify_one();
+    }
+
+    // Waits for the running jobs and joins the threads
+    GLvoid stop() {
+        {
+            lock_guard<mutex> lock(jobsMutex);
+            stopping = true;
+            jobs.clear();
+        }
+        jobsReady.notify_all();
+        for (thread &worker: threads) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+private:
+    GLvoid work() {
+        while (true) {
+            function<void()> job;
+            {
+                unique_lock<mutex> lock(jobsMutex);
+                jobsReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping) {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+};
+
+// A texture that becomes resident asynchronously. The GL name is valid from the
+// start and shows a placeholder until the image has been uploaded into it.
+struct AsyncTexture {
+    GLTexture texture;
+    GLint width = 0;
+    GLint height = 0;
+    GLboolean resident = false;
+};
+
+// Loads images without blocking the frame. Decoding runs on a worker pool; the
+// main thread then maps a pixel buffer object, a worker copies the pixels into it,
+// and the main thread uploads from the PBO, which lets the driver transfer the
+// data without stalling. Every step on the main thread happens in update(), once
+// per frame, and uploads are capped at UPLOAD_BUDGET bytes per frame.
+class TextureLoader {
+private:
+    static constexpr GLuint64 UPLOAD_BUDGET = 16u << 20;
+    static constexpr size_t PAGE_SIZE = 4096;
+
+    using TexStorage2DProc = void (APIENTRYP)(GLenum, GLsizei, GLenum, GLsizei, GLsizei);
+
+    struct Job {
+        weak_ptr<AsyncTexture> target;
+        string path;
+        stbi_uc *pixels = nullptr;
+        GLint width = 0;
+        GLint height = 0;
+        string error;
+        GLuint pixelBuffer = 0;
+        GLvoid *mapped = nullptr;
+        // Cooked textures skip decoding and the PBO: levels upload straight from file
+        AssetData file;
+        optional<TextureFile> cooked;
+        // Set for loadPixels(): the pixels go to this instead of a texture
+        function<void(const uint8_t *, GLint, GLint)> onPixels;
+
+        ~Job() {
+            stbi_image_free(pixels);
+        }
+    };
+
+    RenderState &state;
+    mutex finishedMutex;
+    vector<shared_ptr<Job>> decoded;
+    vector<shared_ptr<Job>> copied;
+    vector<shared_ptr<Job>> readyToUpload;
+    // Jobs owning a pixel buffer, wherever they are; a copy job dropped by
+    // WorkerPool::stop() is only reachable from here
+    vector<shared_ptr<Job>> withPixelBuffer;
+    size_t outstanding = 0;
+    TexStorage2DProc texStorage2D = nullptr;
+    // Last member: stopped first, so no worker outlives the queues above
+    WorkerPool workers;
+
+public:
+    explicit TextureLoader(RenderState &state, size_t workerCount = std::max(thread::hardware_concurrency(), 2u) - 1)
+        : state(state), workers(workerCount) {
+        if (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 2) ||
+            glfwExtensionSupported("GL_ARB_texture_storage")) {
+            texStorage2D = reinterpret_cast<TexStorage2DProc>(glfwGetProcAddress("glTexStorage2D"));
+        }
+    }
+
+    ~TextureLoader() {
+        workers.stop();
+        // Deleting a mapped buffer unmaps it
+        for (const shared_ptr<Job> &job: withPixelBuffer) {
+            glDeleteBuffers(1, &job->pixelBuffer);
+        }
+    }
+
+    TextureLoader(const TextureLoader &) = delete;
+    TextureLoader &operator=(const TextureLoader &) = delete;
+
+    // Returns at once with a placeholder texture; the image replaces it in a
+    // later update(). Dropping the handle early cancels the upload. A cooked
+    // .gbtex next to the requested image (see tools/texcook.cpp) is preferred.
+    // All textures end up with premultiplied alpha.
+    shared_ptr<AsyncTexture> load(const string &path) {
+        shared_ptr<AsyncTexture> handle = make_shared<AsyncTexture>();
+        handle->texture = GLTexture::create();
+        state.bindTexture(0, GL_TEXTURE_2D, handle->texture.get());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        const GLubyte placeholder[4] = {64, 64, 64, 255};
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+
+        shared_ptr<Job> job = make_shared<Job>();
+        job->target = handle;
+        job->path = cookedPath(path);
+        submitDecode(job);
+        return handle;
+    }
+
+    // Decodes an image for use on the CPU, e.g. packing into an atlas. In a later
+    // update() onLoaded gets its premultiplied RGBA8 rows, top first; the pixels
+    // are only valid during the call.
+    GLvoid loadPixels(const string &path, function<void(const uint8_t *, GLint, GLint)> onLoaded) {
+        shared_ptr<Job> job = make_shared<Job>();
+        job->path = cookedPath(path);
+        job->onPixels = std::move(onLoaded);
+        submitDecode(job);
+    }
+
+    // Advances every load by one step; call once per frame on the GL thread
+    GLvoid update() {
+        PROFILE_SCOPE("TextureLoader::update");
+        vector<shared_ptr<Job>> newlyDecoded, newlyCopied;
+        {
+            lock_guard<mutex> lock(finishedMutex);
+            newlyDecoded.swap(decoded);
+            newlyCopied.swap(copied);
+        }
+        readyToUpload.insert(readyToUpload.end(), newlyCopied.begin(), newlyCopied.end());
+
+        for (shared_ptr<Job> &job: newlyDecoded) {
+            if (!job->pixels && !job->cooked) {
+                LOG_ERROR("Failed to load texture: {}", job->path);
+                LOG_ERROR("STB Error: {}", job->error);
+                throw runtime_error("Falha ao carregar a imagem " + job->path);
+            }
+            if (job->onPixels) {
+                job->onPixels(job->cooked ? job->cooked->levelData(0) : job->pixels, job->width, job->height);
+                outstanding--;
+                continue;
+            }
+            if (job->target.expired()) {
+                outstanding--;
+                continue;
+            }
+            if (job->cooked) {
+                readyToUpload.push_back(job);
+                continue;
+            }
+            mapPixelBuffer(*job);
+            withPixelBuffer.push_back(job);
+            workers.submit([this, job] {
+                memcpy(job->mapped, job->pixels, static_cast<size_t>(job->width) * job->height * 4);
+                stbi_image_free(job->pixels);
+                job->pixels = nullptr;
+                lock_guard<mutex> lock(finishedMutex);
+                copied.push_back(job);
+            });
+        }
+
+        GLuint64 uploaded = 0;
+        size_t next = 0;
+        for (; next < readyToUpload.size() && (uploaded == 0 || uploaded < UPLOAD_BUDGET); next++) {
+            uploaded += upload(*readyToUpload[next]);
+            outstanding--;
+        }
+        readyToUpload.erase(readyToUpload.begin(), readyToUpload.begin() + static_cast<ptrdiff_t>(next));
+    }
+
+    // Loads still in progress
+    size_t getOutstanding() const {
+        return outstanding;
+    }
+
+    // Blocks until every requested texture is resident, e.g. for benchmarks
+    GLvoid finish() {
+        while (outstanding > 0) {
+            update();
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }
+
+private:
+    GLvoid submitDecode(const shared_ptr<Job> &job) {
+        outstanding++;
+        workers.submit([this, job] {
+            PROFILE_SCOPE("TextureLoader decode");
+            try {
+                job->file = Assets::instance().load(job->path);
+                span<const uint8_t> bytes = job->file.bytes;
+                if (TextureFile::isTextureFile(bytes)) {
+                    job->cooked = TextureFile::parse(bytes, job->path);
+                    job->width = static_cast<GLint>(job->cooked->getWidth());
+                    job->height = static_cast<GLint>(job->cooked->getHeight());
+                    // Fault the mapped pages in here rather than inside the upload
+                    volatile uint8_t sink = 0;
+                    for (size_t offset = 0; offset < bytes.size(); offset += PAGE_SIZE) {
+                        sink = sink + bytes[offset];
+                    }
+                } else {
+                    int channels;
+                    job->pixels = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()),
+                                                        &job->width, &job->height, &channels, 4);
+                    job->file = AssetData();
+                    if (job->pixels) {
+                        TextureFile::premultiply(job->pixels, static_cast<size_t>(job->width) * job->height);
+                    } else {
+                        job->error = stbi_failure_reason();
+                    }
+                }
+            } catch (const exception &e) {
+                job->error = e.what();
+            }
+            lock_guard<mutex> lock(finishedMutex);
+            decoded.push_back(job);
+        });
+    }
+
+    static string cookedPath(const string &path) {
+        string cooked = filesystem::path(path).replace_extension(".gbtex").generic_string();
+        return cooked != path && Assets::instance().contains(cooked) ? cooked : path;
+    }
+
+    GLvoid mapPixelBuffer(Job &job) {
+        GLsizeiptr size = static_cast<GLsizeiptr>(job.width) * job.height * 4;
+        glGenBuffers(1, &job.pixelBuffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job.pixelBuffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        job.mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (!job.mapped) {
+            glDeleteBuffers(1, &job.pixelBuffer);
+            throw runtime_error("Falha ao mapear o buffer de pixels para " + job.path);
+        }
+    }
+
+    // Returns the bytes uploaded, 0 if the texture was dropped meanwhile
+    GLuint64 upload(Job &job) {
+        if (job.cooked) {
+            return uploadCooked(job);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job.pixelBuffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        GLuint64 bytes = 0;
+        if (shared_ptr<AsyncTexture> target = job.target.lock()) {
+            state.bindTexture(0, GL_TEXTURE_2D, target->texture.get());
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, job.width, job.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            target->width = job.width;
+            target->height = job.height;
+            target->resident = true;
+            bytes = static_cast<GLuint64>(job.width) * job.height * 4;
+            RenderStats::instance().countBufferUpload(bytes);
+            LOG_INFO("Texture loaded successfully: {} ({}x{})", job.path, job.width, job.height);
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &job.pixelBuffer);
+        job.pixelBuffer = 0;
+        std::erase_if(withPixelBuffer, [&job](const shared_ptr<Job> &owner) { return owner.get() == &job; });
+        return bytes;
+    }
+
+    // Every level comes from the file as is: immutable storage when available,
+    // otherwise one glTexImage2D per level
+    GLuint64 uploadCooked(Job &job) {
+        shared_ptr<AsyncTexture> target = job.target.lock();
+        if (!target) {
+            return 0;
+        }
+        const TextureFile &cooked = *job.cooked;
+        GLsizei levels = static_cast<GLsizei>(cooked.getLevelCount());
+        state.bindTexture(0, GL_TEXTURE_2D, target->texture.get());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        if (texStorage2D) {
+            texStorage2D(GL_TEXTURE_2D, levels, GL_RGBA8, job.width, job.height);
+        }
+        for (GLsizei level = 0; level < levels; level++) {
+            const TextureFileLevel &info = cooked.getLevel(static_cast<uint32_t>(level));
+            GLsizei width = static_cast<GLsizei>(info.width), height = static_cast<GLsizei>(info.height);
+            const uint8_t *pixels = cooked.levelData(static_cast<uint32_t>(level));
+            if (texStorage2D) {
+                glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+            } else {
+                glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+            }
+        }
+        target->width = job.width;
+        target->height = job.height;
+        target->resident = true;
+        GLuint64 bytes = cooked.dataSize();
+        RenderStats::instance().countBufferUpload(bytes);
+        LOG_INFO("Texture loaded successfully: {} ({}x{}, {} levels)", job.path, job.width, job.height, levels);
+
+        job.cooked.reset();
+        job.file = AssetData();
+        return bytes;
+    }
+};
+
+// Shelf packing for the texture atlas: rectangles go left to right along
+// horizontal shelves, each into the shelf whose height wastes the least, and a
+// new shelf opens on top of the last when none fits
+class ShelfPacker {
+private:
+    struct Shelf {
+        GLint y, height, x;
+    };
+
+    GLint width, height;
+    vector<Shelf> shelves;
+
+public:
+    ShelfPacker(GLint width, GLint height) : width(width), height(height) {
+    }
+
+    // Top-left corner of the placed rectangle, or nothing when it doesn't fit
+    optional<ivec2> insert(GLint w, GLint h) {
+        Shelf *best = nullptr;
+        for (Shelf &shelf: shelves) {
+            if (h <= shelf.height && shelf.x + w <= width && (!best || shelf.height < best->height)) {
+                best = &shelf;
+            }
+        }
+        if (!best) {
+            GLint top = shelves.empty() ? 0 : shelves.back().y + shelves.back().height;
+            if (w > width || top + h > height) {
+                return nullopt;
+            }
+            shelves.push_back({top, h, 0});
+            best = &shelves.back();
+        }
+        ivec2 position(best->x, best->y);
+        best->x += w;
+        return position;
+    }
+};
+
+// One texture for every tile and sprite, so a frame draws without switching
+// textures. Sheets are cut into cells of a fixed grid and each cell is packed on
+// its own, surrounded by padding texels copied from its edges so neighbours never
+// bleed in. Cells are addressed by tile IDs handed out when their sheet is
+// added; those never change. Sheets stream in through TextureLoader: until one is
+// packed its tiles map to a grey placeholder, and getVersion() changes whenever
+// rectangles do.
+class TextureAtlas {
+private:
+    struct Sheet {
+        string path;
+        GLint columns, rows;
+        GLuint firstTile;
+    };
+
+    RenderState &state;
+    TextureLoader &textures;
+    GLint size;
+    GLint padding;
+    GLTexture texture;
+    ShelfPacker packer;
+    vector<Sheet> sheets;
+    // Texture coordinates (s, t, width, height) by tile ID
+    vector<vec4> rects;
+    vec4 placeholderRect;
+    GLuint64 version = 0;
+
+public:
+    TextureAtlas(RenderState &state, TextureLoader &textures, GLint requestedSize = 2048, GLint padding = 2)
+        : state(state), textures(textures), size(requestedSize), padding(padding), packer(0, 0) {
+        GLint maxSize = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+        size = std::min(size, maxSize);
+        packer = ShelfPacker(size, size);
+
+        texture = GLTexture::create();
+        state.bindTexture(0, GL_TEXTURE_2D, texture.get());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+        const GLubyte grey[4] = {64, 64, 64, 255};
+        placeholderRect = pack(grey, 1, 1, 0, 0, 1, 1);
+        LOG_INFO("Texture atlas created ({}x{}, padding {})", size, size, padding);
+    }
+
+    TextureAtlas(const TextureAtlas &) = delete;
+    TextureAtlas &operator=(const TextureAtlas &) = delete;
+
+    // Queues the image at path, cut into columns x rows cells, and returns the ID
+    // of its first cell; the others follow row by row. Adding the same sheet
+    // again returns the same IDs.
+    GLuint addSheet(const string &path, GLint columns, GLint rows) {
+        for (const Sheet &sheet: sheets) {
+            if (sheet.path == path && sheet.columns == columns && sheet.rows == rows) {
+                return sheet.firstTile;
+            }
+        }
+        GLuint firstTile = static_cast<GLuint>(rects.size());
+        sheets.push_back({path, columns, rows, firstTile});
+        rects.resize(rects.size() + static_cast<size_t>(columns) * rows, placeholderRect);
+
+        textures.loadPixels(path, [this, path, columns, rows, firstTile](const uint8_t *pixels, GLint width, GLint height) {
+            GLint cellWidth = width / columns, cellHeight = height / rows;
+            for (GLint row = 0; row < rows; row++) {
+                for (GLint column = 0; column < columns; column++) {
+                    rects[firstTile + row * columns + column] =
+                        pack(pixels, width, height, column * cellWidth, row * cellHeight, cellWidth, cellHeight);
+                }
+            }
+            version++;
+            LOG_INFO("Packed {} into the atlas ({} tiles of {}x{})", path, columns * rows, cellWidth, cellHeight);
+        });
+        return firstTile;
+    }
+
+    vec4 getRect(GLuint tile) const {
+        return tile < rects.size() ? rects[tile] : placeholderRect;
+    }
+
+    GLuint getTexture() const {
+        return texture.get();
+    }
+
+    GLuint64 getVersion() const {
+        return version;
+    }
+
+private:
+    // Copies the w x h cell at (x, y) of an image into a free spot, padded with
+    // its edge texels, and returns where it landed in texture coordinates
+    vec4 pack(const uint8_t *pixels, GLint imageWidth, GLint imageHeight, GLint x, GLint y, GLint w, GLint h) {
+        GLint paddedWidth = w + 2 * padding, paddedHeight = h + 2 * padding;
+        optional<ivec2> position = packer.insert(paddedWidth, paddedHeight);
+        if (!position) {
+            throw runtime_error("Atlas de texturas cheio");
+        }
+
+        vector<uint8_t> cell(static_cast<size_t>(paddedWidth) * paddedHeight * 4);
+        for (GLint py = 0; py < paddedHeight; py++) {
+            GLint sy = std::clamp(y + py - padding, y, std::min(y + h, imageHeight) - 1);
+            for (GLint px = 0; px < paddedWidth; px++) {
+                GLint sx = std::clamp(x + px - padding, x, std::min(x + w, imageWidth) - 1);
+                memcpy(&cell[(static_cast<size_t>(py) * paddedWidth + px) * 4],
+                       &pixels[(static_cast<size_t>(sy) * imageWidth + sx) * 4], 4);
+            }
+        }
+        state.bindTexture(0, GL_TEXTURE_2D, texture.get());
+        glTexSubImage2D(GL_TEXTURE_2D, 0, position->x, position->y, paddedWidth, paddedHeight,
+                        GL_RGBA, GL_UNSIGNED_BYTE, cell.data());
+        RenderStats::instance().countBufferUpload(cell.size());
+
+        GLfloat scale = 1.0f / static_cast<GLfloat>(size);
+        return vec4(static_cast<GLfloat>(position->x + padding) * scale, static_cast<GLfloat>(position->y + padding) * scale,
+                    static_cast<GLfloat>(w) * scale, static_cast<GLfloat>(h) * scale);
+    }
+};
+
+// Tile types, loaded from a data file (see assets/tiles.txt) in the order maps
+// index them. Properties are kept in parallel arrays: walkability and cost are
+// read per cell by movement and path finding, so they are packed on their own,
+// apart from what only rendering or tools need.
+class TileRegistry {
+private:
+    // Hot: per-cell queries
+    vector<uint8_t> walkable;
+    vector<GLfloat> costs;
+    // Rendering
+    vector<GLuint> atlasTiles;
+    vector<uint8_t> layers;
+    // Cold
+    vector<string> names;
+
+public:
+    // Sheets named by the file are added to atlas
+    TileRegistry(TextureAtlas &atlas, const string &path) {
+        AssetData data = Assets::instance().load(path);
+        istringstream input{string(data.text())};
+        string line;
+        GLint lineNumber = 0;
+        GLuint firstTile = 0;
+        GLint cellCount = 0;
+        while (getline(input, line)) {
+            lineNumber++;
+            istringstream fields(line.substr(0, line.find('#')));
+            string name;
+            if (!(fields >> name)) {
+                continue;
+            }
+            if (name == "folha") {
+                string sheet;
+                GLint columns, rows;
+                if (!(fields >> sheet >> columns >> rows) || columns <= 0 || rows <= 0) {
+                    throw runtime_error("Folha invalida em " + path + ":" + to_string(lineNumber));
+                }
+                firstTile = atlas.addSheet(sheet, columns, rows);
+                cellCount = columns * rows;
+                continue;
+            }
+
+            GLint cell, walk, layer;
+            GLfloat cost;
+            if (!(fields >> cell >> walk >> cost >> layer) || cell < 0 || cell >= cellCount ||
+                (walk != 0 && walk != 1) || cost < 0.0f || layer < 0 || layer > 255) {
+                throw runtime_error("Tipo de tile invalido em " + path + ":" + to_string(lineNumber));
+            }
+            if (contains(name)) {
+                throw runtime_error("Tipo de tile repetido em " + path + ": " + name);
+            }
+            walkable.push_back(static_cast<uint8_t>(walk));
+            costs.push_back(cost);
+            atlasTiles.push_back(firstTile + static_cast<GLuint>(cell));
+            layers.push_back(static_cast<uint8_t>(layer));
+            names.push_back(name);
+        }
+        if (names.empty()) {
+            throw runtime_error("Nenhum tipo de tile em " + path);
+        }
+        LOG_INFO("Tile types loaded: {} ({} types)", path, names.size());
+    }
+
+    size_t size() const {
+        return names.size();
+    }
+
+    // Unknown tile indices are not walkable
+    GLboolean isWalkable(uint16_t tile) const {
+        return tile < walkable.size() && walkable[tile] != 0;
+    }
+
+    GLfloat getCost(uint16_t tile) const {
+        return costs[tile];
+    }
+
+    GLuint getAtlasTile(uint16_t tile) const {
+        return atlasTiles[tile];
+    }
+
+    uint8_t getLayer(uint16_t tile) const {
+        return layers[tile];
+    }
+
+    const string &getName(uint16_t tile) const {
+        return names[tile];
+    }
+
+    GLboolean contains(string_view name) const {
+        return std::find(names.begin(), names.end(), name) != names.end();
+    }
+
+    // Index of the tile type called name
+    uint16_t find(string_view name) const {
+        auto found = std::find(names.begin(), names.end(), name);
+        if (found == names.end()) {
+            throw runtime_error("Tipo de tile desconhecido: " + string(name));
+        }
+        return static_cast<uint16_t>(found - names.begin());
+    }
+};
+
+// Walkability of every map cell as one bit (set = blocked), plus an optional
+// 8-bit movement cost per cell, derived from the map and its tile types. Both
+// have a one-cell blocked border, so any x in [-1, width] and y in [-1, height]
+// may be read without bounds checks, e.g. the neighbours of a cell.
+class WalkabilityGrid {
+private:
+    GLint width = 0;
+    GLint height = 0;
+    // Padded rows of blocked bits; bits past the padded width are blocked too
+    size_t wordsPerRow = 0;
+    vector<uint64_t> blocked;
+    // Padded rows of costs, empty unless enabled
+    vector<uint8_t> costs;
+
+public:
+    // Costs are stored as cost * COST_SCALE, clamped to [1, BLOCKED_COST - 1]
+    static constexpr GLfloat COST_SCALE = 16.0f;
+    static constexpr uint8_t BLOCKED_COST = 255;
+
+    GLvoid build(const MapData &map, const TileRegistry &tiles) {
+        width = static_cast<GLint>(map.getWidth());
+        height = static_cast<GLint>(map.getHeight());
+        wordsPerRow = (static_cast<size_t>(width) + 2 + 63) / 64;
+        blocked.assign(wordsPerRow * (height + 2), ~uint64_t(0));
+        for (GLint y = 0; y < height; y++) {
+            const uint16_t *row = map[y];
+            for (GLint x = 0; x < width; x++) {
+                if (tiles.isWalkable(row[x])) {
+                    size_t bit = static_cast<size_t>(x) + 1;
+                    blocked[(y + 1) * wordsPerRow + bit / 64] &= ~(uint64_t(1) << (bit % 64));
+                }
+            }
+        }
+        if (!costs.empty()) {
+            buildCosts(map, tiles);
+        }
+    }
 
-public:
-    Shader(const GLchar *vertexPath, const GLchar *fragmentPath) {
-        ID = createShaderProgram(vertexPath, fragmentPath);
+    // Keeps the cost grid from now on; it takes a byte per cell
+    GLvoid enableCosts(const MapData &map, const TileRegistry &tiles) {
+        if (costs.empty()) {
+            buildCosts(map, tiles);
+        }
     }
 
-    ~Shader() {
-        glDeleteProgram(ID);
+    GLboolean hasCosts() const {
+        return !costs.empty();
     }
 
-    void use() const {
-        glUseProgram(ID);
+    // Called after the tile at (x, y) changed
+    GLvoid update(GLint x, GLint y, uint16_t tile, const TileRegistry &tiles) {
+        size_t bit = static_cast<size_t>(x) + 1;
+        uint64_t mask = uint64_t(1) << (bit % 64);
+        uint64_t &word = blocked[(y + 1) * wordsPerRow + bit / 64];
+        word = tiles.isWalkable(tile) ? word & ~mask : word | mask;
+        if (!costs.empty()) {
+            costs[static_cast<size_t>(y + 1) * (width + 2) + x + 1] = costOf(tile, tiles);
+        }
     }
 
-    void setMat4(const GLchar *name, const mat4 &matrix) const {
-        GLint location = glGetUniformLocation(ID, name);
-        glUniformMatrix4fv(location, 1, GL_FALSE, value_ptr(matrix));
+    GLboolean isWalkable(GLint x, GLint y) const {
+        size_t bit = static_cast<size_t>(x + 1);
+        return ((blocked[(y + 1) * wordsPerRow + bit / 64] >> (bit % 64)) & 1) == 0;
     }
 
-    GLuint getProgram() const {
-        return ID;
+    // Scaled cost of entering (x, y), BLOCKED_COST if it can't be entered.
+    // Requires enableCosts().
+    uint8_t getCost(GLint x, GLint y) const {
+        return costs[static_cast<size_t>(y + 1) * (width + 2) + x + 1];
     }
 
-private:
-    string readShaderFile(const string &path) const {
-        ifstream shaderFile(path);
-        if (!shaderFile.is_open()) {
-            throw runtime_error("Falha ao abrir o arquivo de shader " + path);
+    // True if any cell in columns [x0, x1) and rows [y0, y1) is blocked; cells off
+    // the map count as blocked. Works a 64-bit word at a time.
+    GLboolean anyBlocked(GLint x0, GLint y0, GLint x1, GLint y1) const {
+        if (x0 >= x1 || y0 >= y1) {
+            return false;
         }
-
-        stringstream shaderStream;
-        shaderStream << shaderFile.rdbuf();
-        shaderFile.close();
-
-        return shaderStream.str();
+        if (x0 < 0 || y0 < 0 || x1 > width || y1 > height) {
+            return true;
+        }
+        size_t firstBit = static_cast<size_t>(x0) + 1, lastBit = static_cast<size_t>(x1);
+        size_t firstWord = firstBit / 64, lastWord = lastBit / 64;
+        uint64_t firstMask = ~uint64_t(0) << (firstBit % 64);
+        uint64_t lastMask = ~uint64_t(0) >> (63 - lastBit % 64);
+        for (GLint y = y0; y < y1; y++) {
+            const uint64_t *row = &blocked[(y + 1) * wordsPerRow];
+            uint64_t any;
+            if (firstWord == lastWord) {
+                any = row[firstWord] & firstMask & lastMask;
+            } else {
+                any = (row[firstWord] & firstMask) | (row[lastWord] & lastMask);
+                for (size_t word = firstWord + 1; word < lastWord; word++) {
+                    any |= row[word];
+                }
+            }
+            if (any != 0) {
+                return true;
+            }
+        }
+        return false;
     }
 
-    GLuint compileShader(const string &source, GLenum type) {
-        GLuint shader = glCreateShader(type);
-        const GLchar *sourcePtr = source.c_str();
-        glShaderSource(shader, 1, &sourcePtr, NULL);
-        glCompileShader(shader);
-
-        GLint success;
-        GLchar infoLog[512];
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-        if (!success) {
-            glGetShaderInfoLog(shader, sizeof(infoLog), nullptr, infoLog);
-            string shaderTypeName = (type == GL_VERTEX_SHADER) ? "VERTEX" : "FRAGMENT";
-            cerr << "Shader source: " << source << endl;
-            throw runtime_error("ERROR::SHADER::" + shaderTypeName + "::COMPILATION_FAILED\n" + infoLog);
+private:
+    GLvoid buildCosts(const MapData &map, const TileRegistry &tiles) {
+        costs.assign(static_cast<size_t>(width + 2) * (height + 2), BLOCKED_COST);
+        for (GLint y = 0; y < height; y++) {
+            const uint16_t *row = map[y];
+            uint8_t *out = &costs[static_cast<size_t>(y + 1) * (width + 2) + 1];
+            for (GLint x = 0; x < width; x++) {
+                out[x] = costOf(row[x], tiles);
+            }
         }
-
-        return shader;
     }
 
-    void checkProgramLinkStatus(GLuint program) {
-        GLint success;
-        GLchar infoLog[512];
-        glGetProgramiv(program, GL_LINK_STATUS, &success);
-        if (!success) {
-            glGetProgramInfoLog(program, sizeof(infoLog), nullptr, infoLog);
-            throw runtime_error(string(PROGRAM_LINK_ERROR) + infoLog);
+    static uint8_t costOf(uint16_t tile, const TileRegistry &tiles) {
+        if (!tiles.isWalkable(tile)) {
+            return BLOCKED_COST;
         }
+        GLfloat scaled = std::round(tiles.getCost(tile) * COST_SCALE);
+        return static_cast<uint8_t>(std::clamp(scaled, 1.0f, BLOCKED_COST - 1.0f));
     }
+};
 
-    GLuint createShaderProgram(const GLchar *vertexPath, const GLchar *fragmentPath) {
-        string vertexCode = readShaderFile(vertexPath);
-        string fragmentCode = readShaderFile(fragmentPath);
+class TileMap {
+private:
+    // Must match the size of tileRects in vertex.vert
+    static constexpr size_t MAX_TILE_TYPES = 64;
+    static constexpr GLfloat TILE_WIDTH = 114.0f;
+    static constexpr GLfloat TILE_HEIGHT = 57.0f;
 
-        GLuint vertexShader = compileShader(vertexCode, GL_VERTEX_SHADER);
-        GLuint fragmentShader = compileShader(fragmentCode, GL_FRAGMENT_SHADER);
+    const TileRegistry *tiles;
+    MapData map;
+    WalkabilityGrid walkability;
+    TextureAtlas &atlas;
+    IsoGrid grid;
+    QuadMesh quad;
 
-        GLuint shaderProgram = glCreateProgram();
-        glAttachShader(shaderProgram, vertexShader);
-        glAttachShader(shaderProgram, fragmentShader);
-        glLinkProgram(shaderProgram);
+    // Per-instance data: grid cell (i, j) and the tile type
+    struct TileInstance {
+        GLushort i, j;
+        GLushort tile;
+        GLushort padding;
+    };
 
-        checkProgramLinkStatus(shaderProgram);
+    // Instances with this tile index are collapsed by vertex.vert
+    static constexpr GLushort INVALID_TILE = 0xFFFF;
 
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
+    // The map is baked in CHUNK_SIZE x CHUNK_SIZE chunks. Each resident chunk owns
+    // a slot of CHUNK_CELLS instances in the shared instance buffer; at most
+    // MAX_RESIDENT_CHUNKS are resident and the least recently drawn is evicted.
+    static constexpr GLint CHUNK_SIZE = 32;
+    static constexpr GLint CHUNK_CELLS = CHUNK_SIZE * CHUNK_SIZE;
+    static constexpr size_t MAX_RESIDENT_CHUNKS = 256;
+    static constexpr GLint CHUNK_REBUILD_BUDGET = 16;
 
-        return shaderProgram;
-    }
-};
+    struct Chunk {
+        GLint slot = -1;
+        GLsizei instanceCount = 0;
+        GLboolean dirty = true;
+    };
 
-class TileMap {
-private:
-    static constexpr int TILEMAP_WIDTH = 3;
-    static constexpr int TILEMAP_HEIGHT = 3;
+    GLVertexArray instanceVAO;
+    GLBuffer instanceVBO;
+    mutable GLboolean atlasDirty = true;
+    mutable GLuint64 atlasVersion = 0;
+    GLuint64 tilesVersion = 0;
 
-    vector<Tile> tileset;
-    int map[TILEMAP_HEIGHT][TILEMAP_WIDTH];
-    GLuint textID;
+    GLint chunkRows = 0;
+    GLint chunkCols = 0;
+    IsoGrid chunkGrid;
+    mutable vector<Chunk> chunks;
+    mutable vector<GLint> slotOwner;
+    mutable vector<GLuint64> slotLastUsed;
+    mutable vector<TileInstance> scratch;
+    mutable GLuint64 frame = 0;
+    mutable GLsizei drawCalls = 0;
+    mutable GLint chunksRebuilt = 0;
 
 public:
-    TileMap(const string &tilesetPath) {
-        int imgWidth, imgHeight;
-        textID = loadTexture(tilesetPath, imgWidth, imgHeight);
+    // Tile images stream into the atlas; until then tiles show its placeholder
+    TileMap(TextureAtlas &atlas, const TileRegistry &tiles, const string &mapPath)
+        : TileMap(atlas, tiles, Assets::instance().loadMap(mapPath)) {
+        LOG_INFO("Map loaded: {} ({}x{})", mapPath, map.getWidth(), map.getHeight());
+    }
+
+    // Takes a map built in memory, e.g. a generated one
+    TileMap(TextureAtlas &atlas, const TileRegistry &tiles, MapData mapData)
+        : tiles(&tiles), map(std::move(mapData)), atlas(atlas) {
+        checkTileCount();
+        walkability.build(map, tiles);
+
+        grid.tileSize = vec2(TILE_WIDTH, TILE_HEIGHT);
 
-        initializeTileset();
+        setupInstancing();
+        setupChunks();
+    }
 
-        initializeMap();
+    // Switches to another set of tile types, e.g. reloaded from its file
+    GLvoid setTiles(const TileRegistry &newTiles) {
+        tiles = &newTiles;
+        tilesVersion++;
+        checkTileCount();
+        walkability.build(map, newTiles);
+        atlasDirty = true;
+        for (Chunk &chunk: chunks) {
+            chunk.dirty = true;
+        }
     }
 
     GLint getHeight() const {
-        return TILEMAP_HEIGHT;
+        return static_cast<GLint>(map.getHeight());
     }
 
     GLint getWidth() const {
-        return TILEMAP_WIDTH;
+        return static_cast<GLint>(map.getWidth());
+    }
+
+    const IsoGrid &getGrid() const {
+        return grid;
+    }
+
+    // Cells overlapping the world rectangle (left, top, right, bottom); shared by
+    // the map and everything drawn on top of it
+    VisibleRange computeVisible(const vec4 &view) const {
+        return grid.visibleRange(view, getWidth(), getHeight());
+    }
+
+    const TileRegistry &getTiles() const {
+        return *tiles;
     }
 
-    vector<Tile> getTileset() const {
-        return tileset;
+    // Changes whenever setTiles() replaces the tile types
+    GLuint64 getTilesVersion() const {
+        return tilesVersion;
     }
 
-    const int *operator[](int index) const {
+    const QuadMesh &getQuad() const {
+        return quad;
+    }
+
+    GLuint getTexture() const {
+        return atlas.getTexture();
+    }
+
+    // Atlas rectangle (s, t, width, height) of a tile type
+    vec4 getTileRect(GLuint tile) const {
+        return tile < tiles->size() ? atlas.getRect(tiles->getAtlasTile(static_cast<uint16_t>(tile))) : vec4(0.0f);
+    }
+
+    const uint16_t *operator[](int index) const {
         return map[index];
     }
 
-    GLvoid draw(const Shader &shader) const {
-        float x0 = 400.0f;
-        float yo = 100.0f;
+    // Draws the chunks overlapping the world rectangle (left, top, right, bottom):
+    // one instanced draw per chunk, whatever the map size. Visible chunks that are
+    // not resident are always built, since they have nothing to draw otherwise.
+    // Resident chunks that changed are rebuilt at most CHUNK_REBUILD_BUDGET per
+    // frame and keep drawing their previous contents until their turn comes.
+    GLvoid draw(const Shader &shader, RenderState &state, const vec4 &view) const {
+        PROFILE_GPU_SCOPE("TileMap::draw");
+        frame++;
+        drawCalls = 0;
+        chunksRebuilt = 0;
+
+        if (atlasDirty || atlasVersion != atlas.getVersion()) {
+            vector<vec4> rects;
+            for (uint16_t tile = 0; tile < tiles->size(); tile++) {
+                rects.push_back(atlas.getRect(tiles->getAtlasTile(tile)));
+            }
+            shader.setArray(shader.uniform<vec4>("tileRects"), rects);
+            atlasDirty = false;
+            atlasVersion = atlas.getVersion();
+        }
 
-        for (int i = 0; i < TILEMAP_HEIGHT; i++) {
-            for (int j = 0; j < TILEMAP_WIDTH; j++) {
-                cout << "Drawing tile at i=" << i << ", j=" << j << endl;
+        // The isometric projection and the atlas lookup are done in vertex.vert
+        state.bindVertexArray(instanceVAO.get());
+        state.bindTexture(0, GL_TEXTURE_2D, atlas.getTexture());
+        state.bindArrayBuffer(instanceVBO.get());
 
-                int tileIndex = map[i][j];
-                if (tileIndex >= tileset.size()) {
-                    cout << "Tile index out of range" << tileIndex << endl;
+        VisibleRange visible = computeVisibleChunks(view);
+        for (GLint ci = visible.firstRow; ci < visible.lastRow; ci++) {
+            const RowSpan &span = visible.spans[ci - visible.firstRow];
+            for (GLint cj = span.begin; cj < span.end; cj++) {
+                GLint index = ci * chunkCols + cj;
+                Chunk &chunk = chunks[index];
+                if (chunk.slot < 0) {
+                    chunk.slot = acquireSlot(index);
+                    if (chunk.slot >= 0) {
+                        rebuildChunk(ci, cj, chunk);
+                    }
+                } else if (chunk.dirty && chunksRebuilt < CHUNK_REBUILD_BUDGET) {
+                    rebuildChunk(ci, cj, chunk);
+                }
+                if (chunk.slot < 0 || chunk.instanceCount == 0) {
                     continue;
                 }
 
-                Tile currentTile = tileset[tileIndex];
+                slotLastUsed[chunk.slot] = frame;
+                setInstanceOffset(static_cast<size_t>(chunk.slot) * CHUNK_CELLS * sizeof(TileInstance));
+                glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, QuadMesh::VERTEX_COUNT, chunk.instanceCount);
+                RenderStats::instance().countDraw(chunk.instanceCount);
+                drawCalls++;
+            }
+        }
+        LOG_EVERY(1.0, LogLevel::Debug, "Map drawn: {} draw calls, {} chunks rebuilt", drawCalls, chunksRebuilt);
+    }
 
-                // Calculate isometric position
-                float x = x0 + (j - i) * currentTile.dimensions.x / 2.0f;
-                float y = yo + (j + i) * currentTile.dimensions.y / 2.0f;
+    // Chunks overlapping a world rectangle, as rows and column spans of the chunk grid
+    VisibleRange computeVisibleChunks(const vec4 &view) const {
+        // A chunk's bounds are those of a CHUNK_SIZE-times larger cell shifted left
+        // by (CHUNK_SIZE - 1) half tiles, so shift the view the other way
+        GLfloat shift = (CHUNK_SIZE - 1) * grid.tileSize.x / 2.0f;
+        return chunkGrid.visibleRange(vec4(view.x + shift, view.y, view.z + shift, view.w), chunkCols, chunkRows);
+    }
 
-                // Create model matrix
-                mat4 model(1.0f);
-                model = translate(model, vec3(x, y, 0.0f));
-                model = scale(model, currentTile.dimensions);
+    GLsizei getDrawCalls() const {
+        return drawCalls;
+    }
 
-                //Set uniforms
-                shader.setMat4("model", model);
-                glUniform2f(glGetUniformLocation(shader.getProgram(), "offsetTex"),
-                            currentTile.iTile * currentTile.ds, 0.0f);
+    GLint getChunksRebuilt() const {
+        return chunksRebuilt;
+    }
 
-                glBindVertexArray(currentTile.VAO);
-                glBindTexture(GL_TEXTURE_2D, currentTile.texID);
-                glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-            }
+    GLvoid setTile(int x, int y, uint16_t tileIndex) {
+        if (x < 0 || x >= getWidth() || y < 0 || y >= getHeight()) {
+            return;
+        }
+        if (map[y][x] != tileIndex) {
+            map[y][x] = tileIndex;
+            walkability.update(x, y, tileIndex, *tiles);
+            chunks[(y / CHUNK_SIZE) * chunkCols + x / CHUNK_SIZE].dirty = true;
         }
-        cout << "Finished drawing map" << endl;
     }
 
     GLboolean isWalkable(int x, int y) const {
-        if (x < 0 || x >= TILEMAP_WIDTH || y < 0 || y >= TILEMAP_HEIGHT) {
+        if (x < 0 || x >= getWidth() || y < 0 || y >= getHeight()) {
             return false;
         }
-        return tileset[map[y][x]].caminhavel;
+        return walkability.isWalkable(x, y);
     }
 
-private:
-    GLvoid initializeTileset() {
-        cout << "Initializing tileset..." << endl;
-        tileset.clear();
-        for (int i = 0; i < 7; i++) {
-            Tile tile;
-            tile.dimensions = vec3(114, 57, 1.0);
-            tile.iTile = i;
-            tile.texID = textID;
-            tile.VAO = setupTile(7, tile.ds, tile.dt);
-            tile.caminhavel = true;
-            tileset.push_back(tile);
-            cout << "Tile " << i << " with ds=" << tile.ds << " dt=" << tile.dt << endl;
-        }
-        tileset[4].caminhavel = false; //agua
-        cout << "Tileset initialization complete. Total tiles: " << tileset.size() << endl;
+    // For path finding and bulk queries; kept in step with setTile()
+    const WalkabilityGrid &getWalkability() const {
+        return walkability;
     }
 
-    GLvoid initializeMap() {
-        GLint defaultMap[TILEMAP_HEIGHT][TILEMAP_WIDTH] = {
-            {1, 1, 4},
-            {4, 1, 4},
-            {4, 4, 1},
-        };
+    // Adds per-cell movement costs to getWalkability()
+    GLvoid enableCostGrid() {
+        walkability.enableCosts(map, *tiles);
+    }
 
-        for (int i = 0; i < TILEMAP_HEIGHT; i++) {
-            for (int j = 0; j < TILEMAP_WIDTH; j++) {
-                map[i][j] = defaultMap[i][j];
-            }
+private:
+    // The shader's tileRects array bounds the number of tile types
+    GLvoid checkTileCount() const {
+        if (tiles->size() > MAX_TILE_TYPES) {
+            throw runtime_error("Tileset com tipos de tile demais");
         }
     }
 
-    GLuint setupTile(int nTiles, float &ds, float &dt) {
-        ds = 1.0f / static_cast<float>(nTiles);
-        dt = 1.0f;
+    GLvoid setupInstancing() {
+        instanceVAO = GLVertexArray::create();
+        instanceVBO = GLBuffer::create();
 
-        float th = 1.0, tw = 1.0;
+        glBindVertexArray(instanceVAO.get());
 
-        GLfloat vertices[] = {
-            // x       y       z    s       t
-            0.0f, th / 2.0f, 0.0f, 0.0f, dt / 2.0f, // A (topo)
-            tw / 2.0f, th, 0.0f, ds / 2.0f, dt, // B (direita)
-            tw / 2.0f, 0.0f, 0.0f, ds / 2.0f, 0.0f, // D (base)
-            tw, th / 2.0f, 0.0f, ds, dt / 2.0f // C (esquerda)
-        };
-
-
-        GLuint VBO, VAO;
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-
-        glBindVertexArray(VAO);
-
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid *) 0);
-        glEnableVertexAttribArray(0);
+        quad.bindAttributes();
 
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid *) (3 * sizeof(GLfloat)));
-        glEnableVertexAttribArray(1);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO.get());
+        setInstanceOffset(0);
+        glEnableVertexAttribArray(2);
+        glVertexAttribDivisor(2, 1);
+        glEnableVertexAttribArray(3);
+        glVertexAttribDivisor(3, 1);
 
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindVertexArray(0);
+    }
 
-        return VAO;
+    // Points the per-instance attributes at a byte offset of the instance buffer,
+    // which must be bound to GL_ARRAY_BUFFER
+    GLvoid setInstanceOffset(size_t offset) const {
+        glVertexAttribIPointer(2, 2, GL_UNSIGNED_SHORT, sizeof(TileInstance),
+                               (GLvoid *) (offset + offsetof(TileInstance, i)));
+        glVertexAttribIPointer(3, 1, GL_UNSIGNED_SHORT, sizeof(TileInstance),
+                               (GLvoid *) (offset + offsetof(TileInstance, tile)));
     }
 
-    GLuint loadTexture(const string &path, int &width, int &height) {
-        GLuint textureID;
-        glGenTextures(1, &textureID);
-        glBindTexture(GL_TEXTURE_2D, textureID);
+    GLvoid setupChunks() {
+        chunkRows = (getHeight() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        chunkCols = (getWidth() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        chunkGrid.tileSize = grid.tileSize * static_cast<GLfloat>(CHUNK_SIZE);
+        chunks.assign(static_cast<size_t>(chunkRows) * chunkCols, Chunk());
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        size_t slots = std::min(chunks.size(), MAX_RESIDENT_CHUNKS);
+        slotOwner.assign(slots, -1);
+        slotLastUsed.assign(slots, 0);
+        scratch.reserve(CHUNK_CELLS);
 
-        int nrChannels;
-        unsigned char *data = stbi_load(path.c_str(), &width, &height, &nrChannels, 0);
-        if (data) {
-            GLenum format = (nrChannels == 3) ? GL_RGB : GL_RGBA;
-            glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
-            cout << "Texture loaded successfully: " << path << " (" << width << "x" << height << ")" << endl;
-        } else {
-            cerr << "Failed to load texture: " << path << endl;
-            cerr << "STB Error: " << stbi_failure_reason() << endl;
-            throw runtime_error("Falha ao carregar a imagem " + path);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO.get());
+        glBufferData(GL_ARRAY_BUFFER, slots * CHUNK_CELLS * sizeof(TileInstance), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // A free slot, or the one least recently drawn; -1 if every slot is in use this frame
+    GLint acquireSlot(GLint chunkIndex) const {
+        GLint victim = -1;
+        for (size_t slot = 0; slot < slotOwner.size(); slot++) {
+            if (slotOwner[slot] < 0) {
+                victim = static_cast<GLint>(slot);
+                break;
+            }
+            if (slotLastUsed[slot] < frame && (victim < 0 || slotLastUsed[slot] < slotLastUsed[victim])) {
+                victim = static_cast<GLint>(slot);
+            }
         }
+        if (victim < 0) {
+            return -1;
+        }
+        if (slotOwner[victim] >= 0) {
+            chunks[slotOwner[victim]].slot = -1;
+        }
+        slotOwner[victim] = chunkIndex;
+        return victim;
+    }
 
-        stbi_image_free(data);
-        glBindTexture(GL_TEXTURE_2D, 0);
+    // Bakes the chunk's cells into its slot; the instance buffer must be bound
+    GLvoid rebuildChunk(GLint ci, GLint cj, Chunk &chunk) const {
+        scratch.clear();
+        GLint lastRow = std::min(getHeight(), (ci + 1) * CHUNK_SIZE);
+        GLint lastCol = std::min(getWidth(), (cj + 1) * CHUNK_SIZE);
+        for (GLint i = ci * CHUNK_SIZE; i < lastRow; i++) {
+            const uint16_t *row = map[i];
+            for (GLint j = cj * CHUNK_SIZE; j < lastCol; j++) {
+                GLushort tileIndex = row[j];
+                if (tileIndex >= tiles->size()) {
+                    tileIndex = INVALID_TILE;
+                }
+                scratch.push_back({static_cast<GLushort>(i), static_cast<GLushort>(j), tileIndex, 0});
+            }
+        }
 
-        return textureID;
+        glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(chunk.slot) * CHUNK_CELLS * sizeof(TileInstance),
+                        static_cast<GLsizeiptr>(scratch.size() * sizeof(TileInstance)), scratch.data());
+        RenderStats::instance().countBufferUpload(scratch.size() * sizeof(TileInstance));
+        chunk.instanceCount = static_cast<GLsizei>(scratch.size());
+        chunk.dirty = false;
+        chunksRebuilt++;
     }
 };
 
 class Player {
 private:
+    // Simulation state at the last two ticks (x = column j, y = row i); rendering
+    // interpolates between them
+    struct PendingMove {
+        int key;
+        double inputTime;
+    };
+
     vec2 position;
+    vec2 previousPosition;
+    vector<PendingMove> pendingMoves;
+    vector<double> appliedInputs;
     const TileMap &tileMap;
+    // Tile type drawn for the player, resolved again when the map's types change
+    mutable GLuint playerTile;
+    mutable GLuint64 playerTileVersion;
 
 public:
-    Player(const TileMap &map) : tileMap(map), position(0, 0) {
+    // Keys the simulation moves the player with; only these repeat while held
+    static constexpr array<GLint, 4> MOVE_KEYS = {GLFW_KEY_W, GLFW_KEY_A, GLFW_KEY_S, GLFW_KEY_D};
+
+    Player(const TileMap &map) : position(0, 0), previousPosition(0, 0), tileMap(map),
+            playerTile(map.getTiles().find("jogador")), playerTileVersion(map.getTilesVersion()) {
+    }
+
+    // Called by the simulation for presses and repeats of held keys; only records
+    // the move for tick(). inputTime is the GLFW timestamp of the input behind it.
+    GLvoid handleInput(int key, int action, double inputTime) {
+        if (action != GLFW_PRESS && action != GLFW_REPEAT) {
+            return;
+        }
+        if (std::find(MOVE_KEYS.begin(), MOVE_KEYS.end(), key) != MOVE_KEYS.end()) {
+            pendingMoves.push_back({key, inputTime});
+        }
+    }
+
+    // One fixed simulation step
+    GLvoid tick() {
+        previousPosition = position;
+        for (const PendingMove &pending: pendingMoves) {
+            move(pending.key);
+            appliedInputs.push_back(pending.inputTime);
+        }
+        pendingMoves.clear();
+    }
+
+    // Moves the timestamps of inputs applied since the last call into out; the
+    // frame rendered next is the first one to show them
+    GLvoid takeAppliedInputs(vector<double> &out) {
+        out.insert(out.end(), appliedInputs.begin(), appliedInputs.end());
+        appliedInputs.clear();
+    }
+
+    // True while rendering would differ between frames
+    GLboolean isActive() const {
+        return !pendingMoves.empty() || previousPosition != position;
+    }
+
+    // Position between the last two ticks; alpha in [0, 1]
+    vec2 interpolatedPosition(GLfloat alpha) const {
+        return mix(previousPosition, position, alpha);
+    }
+
+    // World point at the center of the player, for the camera to follow
+    vec2 getWorldCenter(GLfloat alpha) const {
+        vec2 at = interpolatedPosition(alpha);
+        return tileMap.getGrid().cellCenter(at.y, at.x);
+    }
+
+    GLvoid draw(SpriteBatch &batch, const VisibleRange &visible, GLfloat alpha) const {
+        if (!visible.contains(static_cast<GLint>(position.y), static_cast<GLint>(position.x)) &&
+            !visible.contains(static_cast<GLint>(previousPosition.y), static_cast<GLint>(previousPosition.x))) {
+            return;
+        }
+
+        // Same texture mapping as the tile quads in vertex.vert: the top of the
+        // cell samples the top of its atlas rectangle
+        const IsoGrid &grid = tileMap.getGrid();
+        vec2 at = interpolatedPosition(alpha);
+        if (playerTileVersion != tileMap.getTilesVersion()) {
+            playerTile = tileMap.getTiles().find("jogador");
+            playerTileVersion = tileMap.getTilesVersion();
+        }
+        vec4 rect = tileMap.getTileRect(playerTile);
+        batch.draw(tileMap.getTexture(), grid.toWorld(at.y, at.x), grid.tileSize,
+                   vec4(rect.x, rect.y + rect.w, rect.z, -rect.w), vec4(1.0f), (at.x + at.y) / 65536.0f);
     }
 
-    GLvoid handleInput(int key, int action) {
+private:
+    GLvoid move(int key) {
         vec2 aux = position;
 
-        if (key == GLFW_KEY_W && action == GLFW_PRESS) {
+        if (key == GLFW_KEY_W) {
             if (position.x > 0) position.x--;
             if (position.y > 0) position.y--;
         }
-        if (key == GLFW_KEY_A && action == GLFW_PRESS) {
+        if (key == GLFW_KEY_A) {
             if (position.x > 0) position.x--;
             if (position.y <= tileMap.getHeight() - 2) position.y++;
         }
-        if (key == GLFW_KEY_S && action == GLFW_PRESS) {
+        if (key == GLFW_KEY_S) {
             if (position.x <= tileMap.getWidth() - 2) position.x++;
             if (position.y <= tileMap.getHeight() - 2) position.y++;
         }
-        if (key == GLFW_KEY_D && action == GLFW_PRESS) {
+        if (key == GLFW_KEY_D) {
             if (position.x <= tileMap.getWidth() - 2) position.x++;
             if (position.y > 0) position.y--;
         }
@@ -372,95 +3860,315 @@ public:
             position = aux;
         }
     }
+};
+
+// What a frame of the world is drawn with: GL state, texture streaming, the atlas,
+// the map and sprite shaders and the sprite batch. Game and Benchmark both render
+// through it, so the benchmark measures the frame the game draws. Needs a current
+// GL context.
+class WorldRenderer {
+private:
+    RenderState state;
+    TextureLoader textures;
+    TextureAtlas atlas;
+    Shader shader;
+    Shader spriteShader;
+    SpriteBatch spriteBatch;
+    Uniform<GLint> texBuffUniform;
+    Uniform<vec2> tileSizeUniform;
+
+public:
+    WorldRenderer() : textures(state), atlas(state, textures),
+            shader("shaders/vertex.vert", "shaders/fragment.frag"),
+            spriteShader("shaders/sprite.vert", "shaders/sprite.frag") {
+        state.setDepthTest(true);
+        state.setDepthFunc(GL_ALWAYS);
+        state.setBlend(true);
+        // Textures are premultiplied
+        state.setBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+        texBuffUniform = shader.uniform<GLint>("tex_buff");
+        tileSizeUniform = shader.uniform<vec2>("tileSize");
+    }
+
+    WorldRenderer(const WorldRenderer &) = delete;
+    WorldRenderer &operator=(const WorldRenderer &) = delete;
+
+    // Lets camera feed its matrices to both shaders
+    GLvoid bind(Camera &camera) const {
+        camera.bind(shader);
+        camera.bind(spriteShader);
+    }
+
+    // One frame: advances texture loads, then draws the cells of map in view and,
+    // on top of them in one batch, whatever drawSprites queues
+    GLvoid render(const TileMap &map, Camera &camera,
+                  const function<void(SpriteBatch &, const VisibleRange &)> &drawSprites) {
+        PROFILE_SCOPE("WorldRenderer::render");
+        textures.update();
+
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    GLvoid draw(const Shader &shader) const {
-        Tile current_tile = tileMap.getTileset()[6];
+        // The isometric layout is shared by every tile instance
+        shader.use(state);
+        shader.set(texBuffUniform, 0);
+        shader.set(tileSizeUniform, map.getGrid().tileSize);
+        camera.apply(shader);
+        vec4 bounds = camera.worldBounds();
+        VisibleRange visible = map.computeVisible(bounds);
+        map.draw(shader, state, bounds);
 
-        GLfloat x0 = 400.0f;
-        GLfloat y0 = 100.0f;
+        PROFILE_GPU_SCOPE("Sprites");
+        spriteBatch.begin();
+        drawSprites(spriteBatch, visible);
+        spriteShader.use(state);
+        camera.apply(spriteShader);
+        spriteBatch.end(state);
+    }
 
-        GLfloat x = x0 + (position.x - position.y) * current_tile.dimensions.x / 2.0f;
-        GLfloat y = y0 + (position.x + position.y) * current_tile.dimensions.y / 2.0f;
+    RenderState &getState() {
+        return state;
+    }
 
-        mat4 model = mat4(1.0f);
-        model = translate(model, vec3(x, y, 0.0f));
-        model = scale(model, current_tile.dimensions);
-        shader.setMat4("model", model);
+    TextureLoader &getTextures() {
+        return textures;
+    }
 
-        vec2 offsetTex;
-        offsetTex.s = current_tile.iTile * current_tile.ds;
-        offsetTex.t = 0.0f;
-        glUniform2f(glGetUniformLocation(shader.getProgram(), "offsetTex"), offsetTex.s, offsetTex.t);
+    TextureAtlas &getAtlas() {
+        return atlas;
+    }
 
-        glBindVertexArray(current_tile.VAO);
-        glBindTexture(GL_TEXTURE_2D, current_tile.texID);
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    const Shader &getSpriteShader() const {
+        return spriteShader;
     }
 };
 
+struct GameOptions {
+    string mapPath = "assets/maps/default.txt";
+    PacingMode pacing = PacingMode::Sleep;
+    double targetFps = 60.0;
+    double tickRate = 30.0;
+    double keyRepeatRate = 8.0;
+    GLboolean headless = false;
+    // Frames to render before exiting, 0 runs until the window closes
+    GLuint64 frameLimit = 0;
+    // Directory for headless PNG frame dumps, empty to skip them
+    string dumpDirectory;
+    // Start a profiler capture before loading, so it covers shader and texture loads
+    GLboolean profileStartup = false;
+
+    // --bench: render generated maps headless and report timings instead of playing
+    GLboolean bench = false;
+    vector<GLuint> benchMapSizes = {64, 512, 4096};
+    GLuint benchEntities = 1000;
+    GLuint64 benchFrames = 600;
+    string benchOutput = "bench.json";
+};
+
 class Game {
 private:
+    // After a long stall the simulation drops time instead of running this many
+    // ticks in one frame
+    static constexpr GLint MAX_TICKS_PER_FRAME = 8;
+
+    FrameScheduler scheduler;
+    InputSystem input;
+    vector<double> frameInputs;
+    GLboolean sceneDirty = true;
+    const double tickPeriod;
+    double simulationLag = 0.0;
+    double lastUpdate = 0.0;
+    const GLuint64 frameLimit;
+    const string dumpDirectory;
     Window window;
-    Shader shader;
+    WorldRenderer renderer;
+    TileRegistry tiles;
     TileMap tileMap;
     Player player;
+    Camera camera;
+    LatencyTracker latency;
+    GpuFrameTimer frameTimer;
+    StatsHud hud;
 
 public:
-    Game(): window(800, 600, "Game"),
-            shader("shaders/vertex.vert", "shaders/fragment.frag"),
-            tileMap("assets/tilesetIso.png"),
-            player(tileMap) {
-        glEnable(GL_DEPTH_TEST);
-        glDepthFunc(GL_ALWAYS);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-        shader.use();
+    Game(const GameOptions &options): scheduler(options.pacing, options.targetFps),
+            input(options.keyRepeatRate, Player::MOVE_KEYS),
+            tickPeriod(1.0 / options.tickRate),
+            frameLimit(options.frameLimit),
+            dumpDirectory(options.dumpDirectory),
+            window(800, 600, "Game", options.headless),
+            tiles(renderer.getAtlas(), "assets/tiles.txt"),
+            tileMap(renderer.getAtlas(), tiles, options.mapPath),
+            player(tileMap),
+            camera(800.0f, 600.0f),
+            hud(renderer.getState(), renderer.getSpriteShader()) {
+        ivec2 framebuffer = window.getFramebufferSize();
+        camera.setViewport(static_cast<GLfloat>(framebuffer.x), static_cast<GLfloat>(framebuffer.y));
+        renderer.bind(camera);
+        camera.follow(player.getWorldCenter(1.0f));
 
-        glActiveTexture(GL_TEXTURE0);
-        glUniform1i(glGetUniformLocation(shader.getProgram(), "tex_buff"), 0);
-
-        mat4 projection = ortho(0.0f, 800.0f, 600.0f, 0.0f, -1.0f, 1.0f);
-        shader.setMat4("projection", projection);
+        scheduler.apply(window);
 
         glfwSetWindowUserPointer(window.getHandle(), this);
         glfwSetKeyCallback(window.getHandle(), &Game::keyCallback);
+        glfwSetScrollCallback(window.getHandle(), &Game::scrollCallback);
+        glfwSetFramebufferSizeCallback(window.getHandle(), &Game::framebufferSizeCallback);
     }
 
     static void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods) {
         Game *game = static_cast<Game *>(glfwGetWindowUserPointer(window));
         if (game) {
-            game->player.handleInput(key, action);
+            game->input.push(key, action, glfwGetTime());
+            if (key == GLFW_KEY_F9 && action == GLFW_PRESS) {
+                PROFILE_REQUEST_CAPTURE();
+            }
+            if (key == GLFW_KEY_F3 && action == GLFW_PRESS) {
+                game->hud.toggle();
+            }
+            game->handleCameraInput(key, action);
+            game->sceneDirty = true;
+        }
+    }
+
+    static void scrollCallback(GLFWwindow *window, double /*xOffset*/, double yOffset) {
+        Game *game = static_cast<Game *>(glfwGetWindowUserPointer(window));
+        if (game) {
+            game->camera.zoomBy(yOffset > 0 ? 1.25f : 0.8f);
+            game->sceneDirty = true;
+        }
+    }
+
+    static void framebufferSizeCallback(GLFWwindow *window, int width, int height) {
+        Game *game = static_cast<Game *>(glfwGetWindowUserPointer(window));
+        if (game && width > 0 && height > 0) {
+            glViewport(0, 0, width, height);
+            game->camera.setViewport(static_cast<GLfloat>(width), static_cast<GLfloat>(height));
+            game->sceneDirty = true;
         }
     }
 
     void run() {
-        double lastTime = glfwGetTime();
-        const double targetFPS = 60.0;
-        const double frameTime = 1.0 / targetFPS;
-
-        while (!window.shouldClose()) {
-            double currentTime = glfwGetTime();
-            double deltaTime = currentTime - lastTime;
-            if (deltaTime >= frameTime) {
-                exitGame(window);
-                render();
+        lastUpdate = glfwGetTime();
+        GLuint64 frame = 0;
+        while (!window.shouldClose() && (frameLimit == 0 || frame < frameLimit)) {
+            PROFILE_FRAME();
+            PROFILE_SCOPE("Game::run");
+            scheduler.waitForFrame();
+            latency.poll(glfwGetTime());
+            exitGame(window);
+
+            RenderStats &stats = RenderStats::instance();
+            stats.beginFrame(renderer.getState());
+            auto workStart = chrono::steady_clock::now();
+
+            GLfloat alpha;
+            {
+                PROFILE_SCOPE("Game::update");
+                alpha = update();
+            }
+            player.takeAppliedInputs(frameInputs);
+            frameTimer.begin();
+            render(alpha);
+            frameTimer.end();
+
+            double gpuTime;
+            if (frameTimer.poll(gpuTime)) {
+                stats.setGpuTime(gpuTime);
+            }
+            stats.endFrame(renderer.getState(), chrono::duration<double>(chrono::steady_clock::now() - workStart).count());
+            hud.draw(renderer.getState(), stats.getLastFrame(), scheduler.getLastFrame(), window.getFramebufferSize());
+            if (hud.isVisible()) {
+                camera.invalidate(renderer.getSpriteShader());
+            }
+            // Without new input, a move or a texture load in progress the next frame
+            // would be identical
+            scheduler.setIdle(!sceneDirty && !player.isActive() && !input.anyHeld() &&
+                              renderer.getTextures().getOutstanding() == 0);
+            sceneDirty = false;
+
+            scheduler.beginPresent();
+            {
+                PROFILE_SCOPE("Window::swapBuffers");
                 window.swapBuffers();
-                lastTime = currentTime;
             }
-            glfwPollEvents();
+            latency.frameSubmitted(frameInputs);
+            latency.poll(glfwGetTime());
+            scheduler.endPresent();
+
+            if (!dumpDirectory.empty()) {
+                char name[32];
+                snprintf(name, sizeof(name), "/frame_%06llu.png", static_cast<unsigned long long>(frame));
+                window.saveFrame(dumpDirectory + name);
+            }
+            frame++;
         }
+        PROFILE_SHUTDOWN();
+
+        FrameTiming average = scheduler.getAverage();
+        LOG_INFO("Pacing '{}': {} frames, avg sleep {} ms, work {} ms, present {} ms",
+                 FrameScheduler::modeName(scheduler.getMode()), scheduler.getFrameCount(),
+                 average.sleep * 1000.0, average.work * 1000.0, average.present * 1000.0);
+        LOG_INFO("Input to simulation latency: avg {} ms, max {} ms, {} events dropped",
+                 input.getAverageLatency() * 1000.0, input.getMaxLatency() * 1000.0, input.getDropped());
+        LatencyStats photon = latency.getStats();
+        LOG_INFO("Input to photon latency over {} inputs: p50 {} ms, p95 {} ms, p99 {} ms, max {} ms",
+                 photon.count, photon.p50 * 1000.0, photon.p95 * 1000.0, photon.p99 * 1000.0, photon.max * 1000.0);
+
+        LOG_INFO("GL state changes: {} issued, {} skipped", renderer.getState().getIssued(),
+                 renderer.getState().getSkipped());
+    }
+
+    // Input-to-photon latency measured so far
+    LatencyStats getInputLatency() const {
+        return latency.getStats();
     }
 
 private:
-    GLvoid render() {
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Arrow keys pan the camera away from the player, Home recenters it
+    GLvoid handleCameraInput(int key, int action) {
+        if (action != GLFW_PRESS && action != GLFW_REPEAT) {
+            return;
+        }
+        const GLfloat step = 64.0f;
+        if (key == GLFW_KEY_LEFT) camera.pan(vec2(-step, 0.0f));
+        if (key == GLFW_KEY_RIGHT) camera.pan(vec2(step, 0.0f));
+        if (key == GLFW_KEY_UP) camera.pan(vec2(0.0f, -step));
+        if (key == GLFW_KEY_DOWN) camera.pan(vec2(0.0f, step));
+        if (key == GLFW_KEY_HOME) camera.pan(-camera.getOffset() * camera.getZoom());
+    }
+
+    // Runs as many fixed ticks as the elapsed time calls for (possibly none) and
+    // returns how far the frame is between the last two ticks
+    GLfloat update() {
+        double now = glfwGetTime();
+        simulationLag += now - lastUpdate;
+        lastUpdate = now;
+
+        GLint ticks = 0;
+        while (simulationLag >= tickPeriod && ticks < MAX_TICKS_PER_FRAME) {
+            // The tick covers the oldest tickPeriod of the lag
+            double tickTime = now - simulationLag + tickPeriod;
+            input.drain(tickTime, now, [this](GLint key, GLint action, double eventTime) {
+                player.handleInput(key, action, eventTime);
+            });
+            player.tick();
+            simulationLag -= tickPeriod;
+            ticks++;
+        }
+        if (ticks == MAX_TICKS_PER_FRAME) {
+            simulationLag = std::min(simulationLag, tickPeriod);
+        }
+
+        return static_cast<GLfloat>(simulationLag / tickPeriod);
+    }
 
-        shader.use();
-        glUniform1i(glGetUniformLocation(shader.getProgram(), "tex_buff"), 0);
-        tileMap.draw(shader);
-        player.draw(shader);
+    GLvoid render(GLfloat alpha) {
+        PROFILE_SCOPE("Game::render");
+        camera.follow(player.getWorldCenter(alpha));
+        renderer.render(tileMap, camera, [this, alpha](SpriteBatch &batch, const VisibleRange &visible) {
+            player.draw(batch, visible, alpha);
+        });
     }
 
     GLvoid exitGame(Window &window) {
@@ -469,11 +4177,279 @@ private:
     }
 };
 
-int main() {
+// Deterministic renderer benchmark. For every configured map size it generates a
+// map and a set of entities, flies the camera along a fixed path (a loop around
+// the map center while zooming in and out) for a fixed number of frames, and
+// reports CPU time, GPU time and draw calls per frame. Always headless and
+// uncapped, with the same render path as Game.
+class Benchmark {
+private:
+    // Frames rendered before measuring, so chunk baking and driver warm-up
+    // don't skew the first samples
+    static constexpr GLuint64 WARMUP_FRAMES = 30;
+
+    struct Series {
+        double min = 0.0;
+        double median = 0.0;
+        double p99 = 0.0;
+    };
+
+    struct Result {
+        GLuint mapSize;
+        GLuint entities;
+        GLuint64 frames;
+        Series cpu;
+        Series gpu;
+        Series drawCalls;
+    };
+
+    const GameOptions options;
+    Window window;
+    WorldRenderer renderer;
+    TileRegistry tiles;
+    // Timestamps rather than GL_TIME_ELAPSED, which would clash with the
+    // profiler's GPU scopes inside the frame
+    GpuFrameTimer frameTimer;
+    vector<Result> results;
+
+public:
+    Benchmark(const GameOptions &options) : options(options),
+            window(800, 600, "Benchmark", true),
+            tiles(renderer.getAtlas(), "assets/tiles.txt") {
+        window.setSwapInterval(0);
+    }
+
+    GLvoid run() {
+        for (GLuint size: options.benchMapSizes) {
+            results.push_back(runMap(size));
+        }
+        report();
+    }
+
+private:
+    // Same value for the same cell on every run and platform
+    static GLuint hashCell(GLuint i, GLuint j) {
+        GLuint h = i * 0x9E3779B1u ^ (j + 0x7F4A7C15u) * 0x85EBCA77u;
+        h ^= h >> 15;
+        h *= 0xC2B2AE3Du;
+        h ^= h >> 13;
+        return h;
+    }
+
+    Result runMap(GLuint size) {
+        MapData mapData(size, size);
+        for (GLuint i = 0; i < size; i++) {
+            uint16_t *row = mapData[i];
+            for (GLuint j = 0; j < size; j++) {
+                row[j] = static_cast<uint16_t>(hashCell(i, j) % tiles.size());
+            }
+        }
+        TileMap tileMap(renderer.getAtlas(), tiles, std::move(mapData));
+        // Measure the real atlas, not the placeholder
+        renderer.getTextures().finish();
+        const IsoGrid &grid = tileMap.getGrid();
+
+        vector<uvec2> entities(options.benchEntities);
+        for (GLuint n = 0; n < entities.size(); n++) {
+            entities[n] = uvec2(hashCell(n, 1) % size, hashCell(n, 2) % size);
+        }
+
+        ivec2 framebuffer = window.getFramebufferSize();
+        Camera camera(static_cast<GLfloat>(framebuffer.x), static_cast<GLfloat>(framebuffer.y));
+        renderer.bind(camera);
+
+        vector<double> cpuTimes, gpuTimes, drawCalls;
+        const GLuint64 totalFrames = WARMUP_FRAMES + options.benchFrames;
+        for (GLuint64 frame = 0; frame < totalFrames; frame++) {
+            GLfloat t = static_cast<GLfloat>(frame) / static_cast<GLfloat>(totalFrames);
+            GLfloat angle = t * radians(360.0f);
+            vec2 cell = vec2(0.5f) + 0.4f * vec2(cos(angle), sin(angle));
+            camera.setPosition(grid.cellCenter(cell.y * size, cell.x * size));
+            camera.setZoom(exp2(1.5f * sin(2.0f * angle)));
+
+            GLboolean measure = frame >= WARMUP_FRAMES;
+            if (measure) {
+                frameTimer.begin();
+            }
+            RenderStats::instance().beginFrame(renderer.getState());
+            auto start = chrono::steady_clock::now();
+
+            renderer.render(tileMap, camera, [&](SpriteBatch &batch, const VisibleRange &visible) {
+                for (GLuint n = 0; n < entities.size(); n++) {
+                    uvec2 at = entities[n];
+                    if (!visible.contains(static_cast<GLint>(at.x), static_cast<GLint>(at.y))) {
+                        continue;
+                    }
+                    vec4 rect = tileMap.getTileRect(static_cast<GLuint>(n % tiles.size()));
+                    batch.draw(tileMap.getTexture(), grid.toWorld(at.x, at.y), grid.tileSize,
+                               vec4(rect.x, rect.y + rect.w, rect.z, -rect.w), vec4(1.0f), (at.x + at.y) / 65536.0f);
+                }
+            });
+
+            window.swapBuffers();
+            glfwPollEvents();
+            double cpu = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            RenderStats::instance().endFrame(renderer.getState(), cpu);
+            frameTimer.end();
+            frameTimer.collect(gpuTimes);
+
+            if (measure) {
+                cpuTimes.push_back(cpu);
+                drawCalls.push_back(RenderStats::instance().getLastFrame().drawCalls);
+            }
+        }
+        frameTimer.collect(gpuTimes, true);
+        // The tile map's GL objects die with it; forget what was bound
+        renderer.getState().invalidate();
+
+        Result result{size, options.benchEntities, options.benchFrames,
+                      summarize(cpuTimes), summarize(gpuTimes), summarize(drawCalls)};
+        LOG_INFO("Benchmark {}x{} done: cpu median {} ms, gpu median {} ms",
+                 size, size, result.cpu.median * 1000.0, result.gpu.median * 1000.0);
+        return result;
+    }
+
+    static Series summarize(vector<double> samples) {
+        Series series;
+        if (samples.empty()) {
+            return series;
+        }
+        sort(samples.begin(), samples.end());
+        auto at = [&samples](double fraction) {
+            size_t index = static_cast<size_t>(std::ceil(fraction * static_cast<double>(samples.size()))) - 1;
+            return samples[std::min(index, samples.size() - 1)];
+        };
+        series.min = samples.front();
+        series.median = at(0.5);
+        series.p99 = at(0.99);
+        return series;
+    }
+
+    // Human-readable table on stdout and the same numbers as JSON in benchOutput
+    GLvoid report() const {
+        Logger::instance().flush();
+
+        printf("%-10s %8s %8s | %-26s | %-26s | %-20s\n", "map", "entities", "frames",
+               "cpu ms (min/med/p99)", "gpu ms (min/med/p99)", "draws (min/med/p99)");
+        for (const Result &result: results) {
+            char map[32];
+            snprintf(map, sizeof(map), "%ux%u", result.mapSize, result.mapSize);
+            printf("%-10s %8u %8llu | %8.3f %8.3f %8.3f | %8.3f %8.3f %8.3f | %6.0f %6.0f %6.0f\n", map,
+                   result.entities, static_cast<unsigned long long>(result.frames),
+                   result.cpu.min * 1000.0, result.cpu.median * 1000.0, result.cpu.p99 * 1000.0,
+                   result.gpu.min * 1000.0, result.gpu.median * 1000.0, result.gpu.p99 * 1000.0,
+                   result.drawCalls.min, result.drawCalls.median, result.drawCalls.p99);
+        }
+        fflush(stdout);
+
+        ofstream json(options.benchOutput);
+        if (!json.is_open()) {
+            throw runtime_error("Falha ao criar o arquivo " + options.benchOutput);
+        }
+        auto series = [&json](const char *name, const Series &values, double scale) {
+            json << "\"" << name << "\": {\"min\": " << values.min * scale << ", \"median\": "
+                 << values.median * scale << ", \"p99\": " << values.p99 * scale << "}";
+        };
+        json << "{\n  \"renderer\": \"" << reinterpret_cast<const char *>(glGetString(GL_RENDERER)) << "\",\n";
+        json << "  \"results\": [\n";
+        for (size_t n = 0; n < results.size(); n++) {
+            const Result &result = results[n];
+            json << "    {\"map_size\": " << result.mapSize << ", \"entities\": " << result.entities
+                 << ", \"frames\": " << result.frames << ", ";
+            series("cpu_ms", result.cpu, 1000.0);
+            json << ", ";
+            series("gpu_ms", result.gpu, 1000.0);
+            json << ", ";
+            series("draw_calls", result.drawCalls, 1.0);
+            json << "}" << (n + 1 < results.size() ? "," : "") << "\n";
+        }
+        json << "  ]\n}\n";
+        LOG_INFO("Benchmark results written to {}", options.benchOutput);
+    }
+};
+
+// GBatividade [--pacing vsync|sleep|wait|uncapped] [--fps N] [--tick-rate N] [--key-repeat N]
+//             [--headless] [--frames N] [--dump-frames dir] [--profile] [mapa]
+// GBatividade --bench [--bench-sizes 64,512,4096] [--bench-entities N] [--bench-frames N] [--bench-out arquivo.json]
+GameOptions parseOptions(int argc, char **argv) {
+    GameOptions options;
+    for (int n = 1; n < argc; n++) {
+        string arg = argv[n];
+        if (arg == "--pacing" && n + 1 < argc) {
+            options.pacing = FrameScheduler::parseMode(argv[++n]);
+        } else if (arg == "--tick-rate" && n + 1 < argc) {
+            options.tickRate = stod(argv[++n]);
+            if (options.tickRate <= 0.0) {
+                throw runtime_error("--tick-rate precisa ser positivo");
+            }
+        } else if (arg == "--key-repeat" && n + 1 < argc) {
+            options.keyRepeatRate = stod(argv[++n]);
+            if (options.keyRepeatRate <= 0.0) {
+                throw runtime_error("--key-repeat precisa ser positivo");
+            }
+        } else if (arg == "--fps" && n + 1 < argc) {
+            options.targetFps = stod(argv[++n]);
+            if (options.targetFps <= 0.0) {
+                throw runtime_error("--fps precisa ser positivo");
+            }
+        } else if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--frames" && n + 1 < argc) {
+            options.frameLimit = stoull(argv[++n]);
+        } else if (arg == "--dump-frames" && n + 1 < argc) {
+            options.dumpDirectory = argv[++n];
+        } else if (arg == "--profile") {
+            options.profileStartup = true;
+        } else if (arg == "--bench") {
+            options.bench = true;
+        } else if (arg == "--bench-sizes" && n + 1 < argc) {
+            options.benchMapSizes.clear();
+            stringstream sizes(argv[++n]);
+            string size;
+            while (getline(sizes, size, ',')) {
+                options.benchMapSizes.push_back(static_cast<GLuint>(stoul(size)));
+                if (options.benchMapSizes.back() == 0 || options.benchMapSizes.back() > MapData::MAX_SIZE) {
+                    throw runtime_error("Tamanho de mapa invalido em --bench-sizes: " + size);
+                }
+            }
+        } else if (arg == "--bench-entities" && n + 1 < argc) {
+            options.benchEntities = static_cast<GLuint>(stoul(argv[++n]));
+        } else if (arg == "--bench-frames" && n + 1 < argc) {
+            options.benchFrames = stoull(argv[++n]);
+        } else if (arg == "--bench-out" && n + 1 < argc) {
+            options.benchOutput = argv[++n];
+        } else if (!arg.empty() && arg[0] != '-') {
+            options.mapPath = arg;
+        } else {
+            throw runtime_error("Argumento desconhecido: " + arg);
+        }
+    }
+    if (!options.dumpDirectory.empty() && !options.headless) {
+        throw runtime_error("--dump-frames requer --headless");
+    }
+    return options;
+}
+
+int main(int argc, char **argv) {
     try {
-        Game game;
-        game.run();
+        GameOptions options = parseOptions(argc, argv);
+        Assets::instance().mount("assets.gbpak");
+        if (options.profileStartup) {
+#ifdef GB_PROFILE
+            PROFILE_REQUEST_CAPTURE();
+#else
+            LOG_WARN("--profile ignored: built without GB_PROFILE");
+#endif
+        }
+        if (options.bench) {
+            Benchmark benchmark(options);
+            benchmark.run();
+        } else {
+            Game game(options);
+            game.run();
+        }
     } catch (const exception &e) {
+        Logger::instance().flush();
         cerr << "ERROR: " << e.what() << endl;
         return -1;
     }
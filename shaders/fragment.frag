@@ -2,8 +2,7 @@
 in vec2 tex_coord;
 out vec4 color;
 uniform sampler2D tex_buff;
-uniform vec2 offsetTex;
 
 void main() {
-    color = texture(tex_buff, tex_coord + offsetTex);
+    color = texture(tex_buff, tex_coord);
 }
\ No newline at end of file
@@ -0,0 +1,16 @@
+#version 400
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec2 texC;
+layout(location = 2) in vec4 tint;
+
+out vec2 tex_coord;
+out vec4 tint_color;
+uniform mat4 projection;
+uniform mat4 view;
+
+void main() {
+    // Sprites arrive already placed in world space, depth in z
+    tex_coord = texC;
+    tint_color = tint;
+    gl_Position = projection * view * vec4(position, 1.0f);
+}
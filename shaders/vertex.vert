@@ -1,12 +1,27 @@
 #version 400
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec2 texC;
+layout(location = 2) in uvec2 cell;
+layout(location = 3) in uint tileIndex;
 
 out vec2 tex_coord;
-uniform mat4 model;
 uniform mat4 projection;
+uniform mat4 view;
+uniform vec2 tileSize;
+// Atlas rectangle (s, t, width, height) of each tile type
+uniform vec4 tileRects[64];
 
 void main() {
-    tex_coord = vec2(texC.s, 1.0f-texC.t);
-    gl_Position = projection * model * vec4(position, 1.0f);
+    // Isometric position of cell (i, j) in world space: ((j - i) * w/2, (j + i) * h/2)
+    vec2 grid = vec2(cell);
+    vec2 corner = vec2(grid.y - grid.x, grid.y + grid.x) * tileSize / 2.0f;
+
+    vec4 rect = tileRects[min(tileIndex, 63u)];
+    tex_coord = rect.xy + vec2(texC.s, 1.0f-texC.t) * rect.zw;
+    gl_Position = projection * view * vec4(corner + position.xy * tileSize, position.z, 1.0f);
+
+    // Cells with an unknown tile index collapse to a degenerate quad
+    if (tileIndex == 0xFFFFu) {
+        gl_Position = vec4(0.0f);
+    }
 }
@@ -0,0 +1,46 @@
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "AssetArchive.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Packs every file under the given directories into one archive. Entries are
+// named by their path relative to root with '/' separators, which is how the game
+// asks for them (e.g. "shaders/vertex.vert"). --root switches the root for the
+// directories after it, e.g. to add cooked files from the build tree.
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        cerr << "Uso: assetpack <saida.gbpak> <raiz> <diretorio>... [--root <raiz> <diretorio>...]" << endl;
+        return -1;
+    }
+
+    try {
+        fs::path root = argv[2];
+        vector<pair<string, string>> files;
+        for (int n = 3; n < argc; n++) {
+            if (string(argv[n]) == "--root" && n + 1 < argc) {
+                root = argv[++n];
+                continue;
+            }
+            for (const fs::directory_entry &entry: fs::recursive_directory_iterator(root / argv[n])) {
+                if (entry.is_regular_file()) {
+                    files.emplace_back(fs::relative(entry.path(), root).generic_string(), entry.path().string());
+                }
+            }
+        }
+        sort(files.begin(), files.end());
+
+        AssetArchive::write(argv[1], files);
+        cout << "Packed " << files.size() << " files into " << argv[1] << endl;
+    } catch (const exception &e) {
+        cerr << "ERROR: " << e.what() << endl;
+        return -1;
+    }
+
+    return 0;
+}
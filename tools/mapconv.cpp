@@ -0,0 +1,29 @@
+#include <iostream>
+#include <string>
+#include "MapFile.h"
+
+using namespace std;
+
+// Converts maps between the text (authoring) and binary (runtime) formats.
+// The input format is detected; the output format follows the --text/--binary flag.
+int main(int argc, char **argv) {
+    if (argc != 4 || (string(argv[1]) != "--binary" && string(argv[1]) != "--text")) {
+        cerr << "Uso: mapconv --binary|--text <entrada> <saida>" << endl;
+        return -1;
+    }
+
+    try {
+        MapData map = MapData::load(argv[2]);
+        if (string(argv[1]) == "--binary") {
+            map.saveBinary(argv[3]);
+        } else {
+            map.saveText(argv[3]);
+        }
+        cout << "Converted " << map.getWidth() << "x" << map.getHeight() << " map to " << argv[3] << endl;
+    } catch (const exception &e) {
+        cerr << "ERROR: " << e.what() << endl;
+        return -1;
+    }
+
+    return 0;
+}
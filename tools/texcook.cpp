@@ -0,0 +1,49 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#include "TextureFile.h"
+
+using namespace std;
+
+// Cooks an image into a .gbtex: RGBA8 with premultiplied alpha and an explicit mip
+// chain, ready for the game to upload without decoding. --levels limits the chain
+// (1 keeps only the base level).
+int main(int argc, char **argv) {
+    uint32_t maxLevels = TextureFile::MAX_LEVELS;
+    vector<string> paths;
+    for (int n = 1; n < argc; n++) {
+        string arg = argv[n];
+        if (arg == "--levels" && n + 1 < argc) {
+            maxLevels = static_cast<uint32_t>(stoul(argv[++n]));
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.size() != 2 || maxLevels == 0) {
+        cerr << "Uso: texcook [--levels N] <entrada.png> <saida.gbtex>" << endl;
+        return -1;
+    }
+
+    try {
+        int width, height, channels;
+        stbi_uc *pixels = stbi_load(paths[0].c_str(), &width, &height, &channels, 4);
+        if (!pixels) {
+            throw runtime_error("Falha ao carregar a imagem " + paths[0] + ": " + stbi_failure_reason());
+        }
+        vector<uint8_t> base(pixels, pixels + static_cast<size_t>(width) * height * 4);
+        stbi_image_free(pixels);
+
+        TextureFile::premultiply(base.data(), static_cast<size_t>(width) * height);
+        vector<vector<uint8_t>> chain = TextureFile::buildMipChain(std::move(base), width, height, maxLevels);
+        TextureFile::write(paths[1], width, height, chain);
+        cout << "Cooked " << paths[0] << " (" << width << "x" << height << ", " << chain.size()
+             << " levels) to " << paths[1] << endl;
+    } catch (const exception &e) {
+        cerr << "ERROR: " << e.what() << endl;
+        return -1;
+    }
+
+    return 0;
+}